@@ -0,0 +1,253 @@
+#ifndef AsyncReadback_hpp
+#define AsyncReadback_hpp
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "GL.hpp"
+#include "Texture.hpp"
+
+/**
+ * Ring of pixel pack buffers used to download textures without stalling the CPU.
+ *
+ * Enqueue() records a glGetTexImage into the next buffer of the ring followed by a fence and returns
+ * immediately: the copy runs on the GPU once the commands before it are done. Results are consumed in
+ * submission order, either:
+ *    # Acquire() / Release(): wait on the fence, map the buffer and get a cv::Mat header over the mapping (no copy).
+ *    # a std::future attached at Enqueue(): resolved (with a copy) on the GL thread by Poll(), Acquire(),
+ *      the next Enqueue() (completed downloads) or when the ring wraps.
+ *
+ * With the ring, the download of frame N overlaps the computation of frame N + 1.
+ *
+ * @remark All the calls must be made from the thread owning the GL context. A future is never resolved by
+ * itself: the GL thread must keep polling (or enqueueing) while it, or another thread, waits on it, a
+ * future.get() on the GL thread without Poll() first blocks forever.
+ */
+class AsyncReadback
+{
+public:
+    /**
+     * @param depth Number of pixel pack buffers (downloads in flight).
+     */
+    explicit AsyncReadback(int depth = 3) : _slots(depth), _head(0), _count(0), _acquired(false), _submitted(0)
+    {
+        CV_Assert(depth > 0);
+    }
+
+    ~AsyncReadback()
+    {
+        if (_acquired)
+            Release();
+
+        for (Slot &slot : _slots)
+        {
+            if (slot.fence != nullptr)
+                glDeleteSync(slot.fence);
+            if (slot.buffer != 0)
+                glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+
+    AsyncReadback(const AsyncReadback &) = delete;
+    AsyncReadback &operator=(const AsyncReadback &) = delete;
+
+    /**
+     * @brief Queue the download of a texture (level 0) as 8-bit BGR or BGRA.
+     *
+     * @param texture The texture to download.
+     * @param channels 3 for BGR, 4 for BGRA.
+     * @param result If set, the future resolved with a copy of the pixels.
+     * @return The ticket of the download (submission index).
+     *
+     * @throw std::runtime_error If every buffer holds a result not yet consumed through Acquire().
+     */
+    uint64_t Enqueue(const Texture &texture, int channels = 3, std::future<cv::Mat> *result = nullptr)
+    {
+        // The futures of the completed downloads first, without waiting
+        Poll();
+
+        // Make room: results with a future can be resolved, the others belong to the caller
+        if (_count == static_cast<int>(_slots.size()))
+        {
+            if (_acquired || !Oldest().promise)
+                throw std::runtime_error("AsyncReadback ring full, Acquire() the pending results first");
+            Resolve();
+        }
+
+        Slot &slot = _slots[(_head + _count) % _slots.size()];
+        slot.width = texture.Width();
+        slot.height = texture.Height();
+        slot.channels = channels;
+        slot.ticket = _submitted++;
+
+        const GLsizeiptr size = static_cast<GLsizeiptr>(slot.width) * slot.height * channels;
+        if (slot.buffer == 0)
+            glGenBuffers(1, &slot.buffer);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        if (size != slot.size)
+        {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+            slot.size = size;
+        }
+
+        // Tightly packed rows, so the mapping can be wrapped by a continuous cv::Mat
+        texture.Bind();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, channels == 4 ? GL_BGRA : GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        texture.UnBind();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        slot.promise.reset();
+        if (result != nullptr)
+        {
+            slot.promise = std::make_unique<std::promise<cv::Mat>>();
+            *result = slot.promise->get_future();
+        }
+
+        ++_count;
+        return slot.ticket;
+    }
+
+    /**
+     * @brief Number of downloads not consumed yet.
+     */
+    int Pending() const { return _count; }
+
+    /**
+     * @brief Check if the oldest download is complete, without blocking.
+     */
+    bool Ready() const
+    {
+        if (_count == 0)
+            return false;
+        GLenum status = glClientWaitSync(_slots[_head].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+    }
+
+    /**
+     * @brief Wait for the oldest download and map it.
+     * Downloads with a future attached are resolved on the way.
+     *
+     * @param mat Set to a header over the mapped buffer, valid until Release().
+     * @param ticket If set, receives the ticket returned by Enqueue().
+     * @return false if there is nothing left to acquire.
+     */
+    bool Acquire(cv::Mat &mat, uint64_t *ticket = nullptr)
+    {
+        CV_Assert(!_acquired);
+
+        while (_count > 0 && Oldest().promise)
+            Resolve();
+        if (_count == 0)
+            return false;
+
+        Slot &slot = Oldest();
+        mat = Map(slot);
+        _acquired = true;
+        if (ticket != nullptr)
+            *ticket = slot.ticket;
+        return true;
+    }
+
+    /**
+     * @brief Unmap the acquired buffer and give it back to the ring.
+     */
+    void Release()
+    {
+        CV_Assert(_acquired);
+        Unmap(Oldest());
+        Pop();
+        _acquired = false;
+    }
+
+    /**
+     * @brief Resolve the futures whose download is complete.
+     *
+     * @param wait Block until every pending future is resolved.
+     */
+    void Poll(bool wait = false)
+    {
+        // The acquired buffer is the oldest one, the results behind it wait for Release()
+        if (_acquired)
+            return;
+
+        while (_count > 0 && Oldest().promise && (wait || Ready()))
+            Resolve();
+    }
+
+private:
+    struct Slot
+    {
+        GLuint buffer = 0;
+        GLsizeiptr size = 0;
+        GLsync fence = nullptr;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        uint64_t ticket = 0;
+        std::unique_ptr<std::promise<cv::Mat>> promise;
+    };
+
+    Slot &Oldest() { return _slots[_head]; }
+
+    /**
+     * @brief Wait for the fence of a slot, then map its buffer.
+     */
+    cv::Mat Map(Slot &slot)
+    {
+        WaitSync(slot.fence);
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (data == nullptr)
+            throw std::runtime_error("AsyncReadback glMapBufferRange failed");
+
+        return cv::Mat(slot.height, slot.width, CV_8UC(slot.channels), data);
+    }
+
+    void Unmap(Slot &slot)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    /**
+     * @brief Complete the oldest download into its future.
+     */
+    void Resolve()
+    {
+        Slot &slot = Oldest();
+        cv::Mat mapped = Map(slot);
+        slot.promise->set_value(mapped.clone());
+        slot.promise.reset();
+        Unmap(slot);
+        Pop();
+    }
+
+    void Pop()
+    {
+        _head = (_head + 1) % _slots.size();
+        --_count;
+    }
+
+private:
+    std::vector<Slot> _slots;
+    size_t _head;
+    int _count;
+    bool _acquired;
+    uint64_t _submitted;
+};
+
+#endif // AsyncReadback_hpp
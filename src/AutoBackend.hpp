@@ -0,0 +1,302 @@
+#ifndef AutoBackend_hpp
+#define AutoBackend_hpp
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "Benchmark.hpp"
+#include "ConfigFile.hpp"
+#include "Convolution.hpp"
+#include "FilterBackend.hpp"
+#include "GL.hpp"
+#include "Kernel.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * Predicted time of a backend for an image and a kernel, in ns:
+ * launch + pixels * (pixel + taps * tap).
+ *
+ * launch holds the fixed costs of a call (thread wake-up, draw / dispatch, synchronization), pixel the costs
+ * proportional to the image (upload, readback, conversions) and tap the cost of one tap of the kernel.
+ */
+struct BackendCost
+{
+    double launch = 0.0;
+    double pixel = 0.0;
+    double tap = 0.0;
+
+    double Predict(double pixels, int taps) const
+    {
+        return launch + pixels * (pixel + taps * tap);
+    }
+
+    /**
+     * @brief The taps computed per pixel: 2 * size for the separable kernels (two passes), size * size otherwise.
+     */
+    static int Taps(const Kernel &kernel)
+    {
+        return kernel.IsSeparable() ? 2 * kernel.size : kernel.size * kernel.size;
+    }
+};
+
+/**
+ * Backend costs measured on this machine, stored in a small text file.
+ *
+ * One line per backend: "key launch pixel tap" (ns), the key holds the name of the backend and the machine
+ * (CPU kernel tier, threads, GL renderer), e.g. "Compute_Shader@AVX2/8/NVIDIA_GeForce_RTX_3060 52000 0.9 0.01".
+ * '#' starts a comment.
+ *
+ * Location: $GL_COMPUTE_COST_MODEL, else $XDG_CONFIG_HOME/gl-compute/cost-model.conf, else ~/.config/gl-compute/cost-model.conf.
+ */
+class CostModel
+{
+public:
+    CostModel() : _file("GL_COMPUTE_COST_MODEL", "cost-model.conf", "CostModel") { Load(); }
+
+    explicit CostModel(const std::filesystem::path &path) : _file(path, "CostModel") { Load(); }
+
+    const std::filesystem::path &Path() const { return _file.Path(); }
+
+    bool Get(const std::string &key, BackendCost &cost) const
+    {
+        auto found = _costs.find(key);
+        if (found == _costs.end())
+            return false;
+        cost = found->second;
+        return true;
+    }
+
+    void Set(const std::string &key, const BackendCost &cost)
+    {
+        _costs[key] = cost;
+    }
+
+    /**
+     * @brief Write every cost (the directory is created when needed).
+     *
+     * @return false if the file cannot be written.
+     */
+    bool Save() const
+    {
+        return _file.Write("gl-compute backend costs: key launch_ns pixel_ns tap_ns", [&](std::ostream &file)
+        {
+            for (const auto &[key, cost] : _costs)
+                file << key << " " << cost.launch << " " << cost.pixel << " " << cost.tap << "\n";
+        });
+    }
+
+private:
+    /**
+     * @brief Read the costs, a missing file is an empty model and invalid lines are skipped.
+     */
+    void Load()
+    {
+        _file.Read([&](std::istringstream &fields)
+        {
+            std::string key;
+            BackendCost cost;
+            if (fields >> key >> cost.launch >> cost.pixel >> cost.tap && cost.launch >= 0.0 && cost.pixel >= 0.0 && cost.tap >= 0.0)
+                _costs[key] = cost;
+        });
+    }
+
+private:
+    ConfigFile _file;
+    std::map<std::string, BackendCost> _costs;
+};
+
+/**
+ * Picks, per call, the registered backend with the smallest predicted time for the size of the image and
+ * the kernel: the fixed costs of the GPU paths keep thumbnails on the CPU, the per-pixel costs send large
+ * frames to the GPU. The composite backends (see IFilterBackend::Composite()) are left out.
+ *
+ * The costs come from a short benchmark of every other backend (two image sizes, two kernel sizes), run once per
+ * machine on first use and stored in the CostModel file.
+ *
+ * @remark The CPU backends leave the border of the kernel radius black, the GPU ones clamp it: the
+ * borders of the output depend on the chosen backend.
+ */
+class AutoBackend : public IFilterBackend
+{
+public:
+    explicit AutoBackend(const FilterBackendRegistry &registry) : _registry(registry), _last(nullptr) {}
+
+    std::string Name() const override { return "Auto"; }
+
+    bool Composite() const override { return true; }
+
+    void Filter(const cv::Mat &input, cv::Mat &output, const Kernel &kernel) override
+    {
+        IFilterBackend &backend = Choose(input.cols, input.rows, kernel);
+        if (&backend != _last)
+        {
+            std::cout << "[AutoBackend] " << input.cols << "x" << input.rows << " " << kernel.name << " : " << backend.Name() << std::endl;
+            _last = &backend;
+        }
+        backend.Filter(input, output, kernel);
+    }
+
+    /**
+     * @brief The backend with the smallest predicted time (the backends are calibrated first when needed).
+     *
+     * @throw std::runtime_error If no other backend is registered.
+     */
+    IFilterBackend &Choose(int cols, int rows, const Kernel &kernel)
+    {
+        Calibrate(false);
+
+        const double pixels = static_cast<double>(cols) * rows;
+        const int taps = BackendCost::Taps(kernel);
+
+        IFilterBackend *best = nullptr;
+        double bestTime = 0.0;
+        for (IFilterBackend *backend : Candidates())
+        {
+            BackendCost cost;
+            if (!_model.Get(KeyOf(*backend), cost))
+                continue;
+            const double time = cost.Predict(pixels, taps);
+            if (best == nullptr || time < bestTime)
+            {
+                best = backend;
+                bestTime = time;
+            }
+        }
+
+        if (best == nullptr)
+            throw std::runtime_error("No backend to choose from");
+        return *best;
+    }
+
+    /**
+     * @brief Measure the backends missing from the cost model (every backend when forced) and save the model.
+     */
+    void Calibrate(bool force)
+    {
+        bool changed = false;
+        for (IFilterBackend *backend : Candidates())
+        {
+            BackendCost cost;
+            if (!force && _model.Get(KeyOf(*backend), cost))
+                continue;
+
+            cost = Measure(*backend);
+            std::cout << "[AutoBackend] Calibrated " << backend->Name() << " : launch " << cost.launch * 1e-6 << " ms, "
+                      << cost.pixel << " ns/pixel, " << cost.tap << " ns/pixel/tap" << std::endl;
+            _model.Set(KeyOf(*backend), cost);
+            changed = true;
+        }
+
+        if (changed)
+            _model.Save();
+    }
+
+    CostModel &Model() { return _model; }
+
+private:
+    /**
+     * @brief The backends to measure and choose from: the registered ones but the composite ones (this one,
+     * Hybrid), whose timing would adapt their state and which would run the candidates in parallel.
+     */
+    std::vector<IFilterBackend *> Candidates() const
+    {
+        std::vector<IFilterBackend *> candidates;
+        for (IFilterBackend *backend : _registry.Backends())
+            if (!backend->Composite())
+                candidates.push_back(backend);
+        return candidates;
+    }
+
+    /**
+     * @brief The key of a backend on this machine.
+     */
+    static std::string KeyOf(const IFilterBackend &backend)
+    {
+        static const std::string machine = Machine();
+        return backend.Name() + "@" + machine;
+    }
+
+    static std::string Machine()
+    {
+        const GLubyte *renderer = glGetString(GL_RENDERER);
+        std::string machine = CpuIsaName(ActiveCpuIsa()) + "/" + std::to_string(ThreadPool::Shared().Threads()) + "/" +
+                              (renderer != nullptr ? reinterpret_cast<const char *>(renderer) : "none");
+        std::replace_if(machine.begin(), machine.end(), [](unsigned char c)
+                        { return std::isspace(c) != 0; }, '_');
+        return machine;
+    }
+
+    /**
+     * @brief Median time of a backend (ns) after one untimed call.
+     */
+    static double Time(IFilterBackend &backend, const cv::Mat &input, const Kernel &kernel)
+    {
+        typedef std::chrono::steady_clock clock;
+
+        cv::Mat output;
+        backend.Filter(input, output, kernel);
+
+        std::vector<double> samples;
+        for (int i = 0; i < 3; ++i)
+        {
+            auto t0 = clock::now();
+            backend.Filter(input, output, kernel);
+            auto t1 = clock::now();
+            samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+        }
+        return BenchmarkStats::From(samples).median;
+    }
+
+    /**
+     * @brief Fit the costs of a backend: a small and a large image with a 3x3 kernel give the launch and
+     * per-pixel costs, the large image with a 7x7 kernel the per-tap cost. Both kernels are not separable.
+     */
+    static BackendCost Measure(IFilterBackend &backend)
+    {
+        const int smallSide = 64;
+        const int largeSide = 1024;
+
+        cv::Mat large(largeSide, largeSide, CV_8UC3);
+        for (int y = 0; y < large.rows; ++y)
+            for (int x = 0; x < large.cols * 3; ++x)
+                large.ptr<uint8_t>(y)[x] = static_cast<uint8_t>((x * 7 + y * 13 + (x * y) % 31) & 255);
+        const cv::Mat small = large(cv::Rect(0, 0, smallSide, smallSide)).clone();
+
+        std::vector<float> weights(49);
+        for (int i = 0; i < 49; ++i)
+            weights[i] = static_cast<float>((i * i) % 7) - 3.0f;
+        const Kernel kernel3 = Kernel::Edge();
+        const Kernel kernel7("calibration", 7, weights, 49.0f, 128.0f);
+
+        const double smallPixels = static_cast<double>(smallSide) * smallSide;
+        const double largePixels = static_cast<double>(largeSide) * largeSide;
+        const int taps3 = BackendCost::Taps(kernel3);
+        const int taps7 = BackendCost::Taps(kernel7);
+
+        const double small3 = Time(backend, small, kernel3);
+        const double large3 = Time(backend, large, kernel3);
+        const double large7 = Time(backend, large, kernel7);
+
+        BackendCost cost;
+        const double perPixel3 = std::max(0.0, (large3 - small3) / (largePixels - smallPixels));
+        cost.launch = std::max(0.0, small3 - smallPixels * perPixel3);
+        cost.tap = std::max(0.0, (large7 - large3) / (largePixels * (taps7 - taps3)));
+        cost.pixel = std::max(0.0, perPixel3 - taps3 * cost.tap);
+        return cost;
+    }
+
+private:
+    const FilterBackendRegistry &_registry;
+    CostModel _model;
+    IFilterBackend *_last;
+};
+
+#endif // AutoBackend_hpp
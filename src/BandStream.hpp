@@ -0,0 +1,243 @@
+#ifndef BandStream_hpp
+#define BandStream_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+/**
+ * Sequential reader of a binary PPM (P6, 8 bits per channel): the rows are read on demand, the image
+ * is never resident as a whole.
+ */
+class PpmReader
+{
+public:
+    /**
+     * @brief Open the file and read its header.
+     *
+     * @throw std::runtime_error If the file cannot be opened or is not an 8-bit P6 PPM.
+     */
+    explicit PpmReader(const std::string &path) : _path(path), _file(path, std::ios::binary), _width(0), _height(0), _row(0)
+    {
+        if (!_file)
+            throw std::runtime_error("Cannot open " + path);
+
+        std::string magic;
+        int maxValue = 0;
+        _file >> magic;
+        if (magic != "P6" || !ReadNumber(_width) || !ReadNumber(_height) || !ReadNumber(maxValue) || _width <= 0 || _height <= 0)
+            throw std::runtime_error(path + " is not a binary PPM (P6)");
+        if (maxValue != 255)
+            throw std::runtime_error(path + ": only 8-bit PPM are supported (maxval " + std::to_string(maxValue) + ")");
+
+        // A single whitespace separates the header from the pixels
+        _file.get();
+    }
+
+    int Width() const { return _width; }
+    int Height() const { return _height; }
+
+    /**
+     * @brief The index of the next row to read.
+     */
+    int Row() const { return _row; }
+
+    /**
+     * @brief Read the next rows into consecutive rows of an image.
+     *
+     * @param rows The destination (3 channels, Width() columns), one row per image row.
+     * @throw std::runtime_error If the file ends early.
+     */
+    void Read(cv::Mat rows)
+    {
+        CV_Assert(rows.type() == CV_8UC3 && rows.cols == _width && _row + rows.rows <= _height);
+
+        for (int y = 0; y < rows.rows; ++y)
+            if (!_file.read(reinterpret_cast<char *>(rows.ptr<uint8_t>(y)), static_cast<std::streamsize>(_width) * 3))
+                throw std::runtime_error(_path + ": unexpected end of file at row " + std::to_string(_row + y));
+        _row += rows.rows;
+    }
+
+private:
+    /**
+     * @brief Read a header number, skipping the whitespace and the comments.
+     */
+    bool ReadNumber(int &value)
+    {
+        for (;;)
+        {
+            _file >> std::ws;
+            if (_file.peek() != '#')
+                break;
+            std::string comment;
+            std::getline(_file, comment);
+        }
+        return static_cast<bool>(_file >> value);
+    }
+
+private:
+    std::string _path;
+    std::ifstream _file;
+    int _width;
+    int _height;
+    int _row;
+};
+
+/**
+ * Sequential writer of a binary PPM (P6, 8 bits per channel).
+ */
+class PpmWriter
+{
+public:
+    /**
+     * @brief Create the file and write its header.
+     *
+     * @throw std::runtime_error If the file cannot be created.
+     */
+    PpmWriter(const std::string &path, int width, int height) : _path(path), _file(path, std::ios::binary), _width(width), _height(height), _row(0)
+    {
+        if (!_file)
+            throw std::runtime_error("Cannot create " + path);
+        _file << "P6\n"
+              << width << " " << height << "\n255\n";
+    }
+
+    /**
+     * @brief Append rows.
+     *
+     * @param rows The rows to write (3 channels, width columns).
+     * @throw std::runtime_error If the write fails (disk full, ...).
+     */
+    void Write(const cv::Mat &rows)
+    {
+        CV_Assert(rows.type() == CV_8UC3 && rows.cols == _width && _row + rows.rows <= _height);
+
+        for (int y = 0; y < rows.rows; ++y)
+            _file.write(reinterpret_cast<const char *>(rows.ptr<uint8_t>(y)), static_cast<std::streamsize>(_width) * 3);
+        if (!_file)
+            throw std::runtime_error("Cannot write " + _path);
+        _row += rows.rows;
+    }
+
+    int Row() const { return _row; }
+
+private:
+    std::string _path;
+    std::ofstream _file;
+    int _width;
+    int _height;
+    int _row;
+};
+
+/**
+ * Measurements of a streamed run.
+ */
+struct BandStats
+{
+    int width = 0;
+    int height = 0;
+    int bands = 0;
+    // Peak size of the band buffers (input with its halo and output)
+    size_t peakBytes = 0;
+    double seconds = 0.0;
+
+    void Print(std::ostream &out) const
+    {
+        const double pixels = static_cast<double>(width) * height;
+        out << "[BandStream] " << width << "x" << height << " in " << bands << " bands, "
+            << seconds * 1e3 << " ms (" << (seconds > 0.0 ? pixels / seconds * 1e-6 : 0.0) << " MPix/s), "
+            << "band buffers " << peakBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+};
+
+/**
+ * Band by band filtering of images larger than the memory.
+ *
+ * The source is read in horizontal bands of bandHeight output rows plus a halo of radius rows on each side,
+ * each band is filtered as an image of its own and its bandHeight rows are written before the next band is
+ * read. The 2 * radius rows shared by consecutive bands are carried over, every source row is read once.
+ * Memory is O(width x bandHeight) whatever the height of the image.
+ *
+ * The result is the one of filtering the whole image: only the rows of a band that are at least radius rows
+ * from its edges are kept, except at the top and the bottom of the image where the band edge is the image edge.
+ */
+class BandStream
+{
+public:
+    typedef std::function<void(const cv::Mat &input, cv::Mat &output)> FilterFn;
+
+    /**
+     * @param radius The radius of the kernel (halo rows on each side of a band).
+     * @param bandHeight The output rows per band.
+     */
+    BandStream(int radius, int bandHeight) : _radius(radius), _bandHeight(bandHeight)
+    {
+        if (radius < 0 || bandHeight < 1)
+            throw std::runtime_error("Invalid band height " + std::to_string(bandHeight));
+    }
+
+    /**
+     * @brief Filter the whole source into the destination.
+     *
+     * @param reader The source, positioned on its first row.
+     * @param writer The destination, same size as the source.
+     * @param filter Filters a band (any backend: CPU, fragment or compute shader).
+     */
+    BandStats Run(PpmReader &reader, PpmWriter &writer, const FilterFn &filter)
+    {
+        typedef std::chrono::steady_clock clock;
+        const auto start = clock::now();
+
+        const int width = reader.Width();
+        const int height = reader.Height();
+
+        BandStats stats;
+        stats.width = width;
+        stats.height = height;
+
+        // Two buffers: the halo of the previous band is copied to the top of the next one
+        const int capacity = _bandHeight + 2 * _radius;
+        cv::Mat buffers[2] = {cv::Mat(capacity, width, CV_8UC3), cv::Mat(capacity, width, CV_8UC3)};
+        int current = 0;
+        int bufferTop = 0; // source row of the first buffer row
+        cv::Mat output;
+
+        for (int y0 = 0; y0 < height; y0 += _bandHeight)
+        {
+            const int y1 = std::min(y0 + _bandHeight, height);
+            const int top = std::max(0, y0 - _radius);
+            const int bottom = std::min(height, y1 + _radius);
+
+            // Rows [top, reader.Row()) are already in the previous buffer
+            cv::Mat &band = buffers[current];
+            const int carried = reader.Row() - top;
+            if (carried > 0)
+                buffers[1 - current].rowRange(top - bufferTop, reader.Row() - bufferTop).copyTo(band.rowRange(0, carried));
+            reader.Read(band.rowRange(std::max(carried, 0), bottom - top));
+            bufferTop = top;
+
+            const cv::Mat input = band.rowRange(0, bottom - top);
+            filter(input, output);
+            writer.Write(output.rowRange(y0 - top, y1 - top));
+
+            stats.bands++;
+            stats.peakBytes = std::max(stats.peakBytes, 2 * band.total() * band.elemSize() + output.total() * output.elemSize());
+            current = 1 - current;
+        }
+
+        stats.seconds = std::chrono::duration<double>(clock::now() - start).count();
+        return stats;
+    }
+
+private:
+    int _radius;
+    int _bandHeight;
+};
+
+#endif // BandStream_hpp
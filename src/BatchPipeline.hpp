@@ -0,0 +1,296 @@
+#ifndef BatchPipeline_hpp
+#define BatchPipeline_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "BoundedQueue.hpp"
+
+/**
+ * Time spent by the threads of a pipeline stage on their work (waits on the queues excluded).
+ */
+struct StageStats
+{
+    std::string name;
+    int threads = 0;
+    double busySeconds = 0.0;
+
+    /**
+     * @brief The busy fraction of the threads of the stage over a run.
+     */
+    double Utilization(double seconds) const
+    {
+        return threads > 0 && seconds > 0.0 ? busySeconds / (threads * seconds) : 0.0;
+    }
+};
+
+/**
+ * Threads of each stage of a BatchPipeline and capacity of the queues between them.
+ */
+struct BatchConfig
+{
+    int decodeThreads = 2;
+    int filterThreads = 1;
+    int encodeThreads = 2;
+    int queueDepth = 4;
+};
+
+/**
+ * Measurements of a batch run.
+ */
+struct BatchStats
+{
+    int images = 0;
+    int failed = 0;
+    double seconds = 0.0;
+    std::vector<StageStats> stages;
+
+    void Print(std::ostream &out) const
+    {
+        out << "[BatchPipeline] " << images << " images (" << failed << " failed) in " << seconds << " s, "
+            << (seconds > 0.0 ? images / seconds : 0.0) << " images/s" << std::endl;
+        for (const StageStats &stage : stages)
+            out << "[BatchPipeline]   " << stage.name << " : " << stage.threads << " threads, "
+                << stage.Utilization(seconds) * 100.0 << "% busy" << std::endl;
+    }
+};
+
+/**
+ * Filters a corpus of image files: decode, filter and encode run as three stages of threads joined by
+ * bounded queues, so the JPEG / PNG codecs of the decode and encode stages overlap the filter and never
+ * hold more than a few images per queue in memory.
+ *
+ * The filter stage runs on the calling thread (the one holding the GL context for the GPU backends),
+ * plus filterThreads - 1 helper threads for the backends safe to call from any thread (CPU).
+ * The outputs keep the file name (and format) of their input.
+ */
+class BatchPipeline
+{
+public:
+    typedef std::function<void(const cv::Mat &input, cv::Mat &output)> FilterFn;
+
+    /**
+     * @param config The threads of each stage (the filter threads include the calling one) and the images
+     * each queue holds at most.
+     * @throw std::runtime_error If a stage has no thread or the queues no room.
+     */
+    explicit BatchPipeline(const BatchConfig &config) : _config(config)
+    {
+        if (config.decodeThreads < 1 || config.filterThreads < 1 || config.encodeThreads < 1 || config.queueDepth < 1)
+            throw std::runtime_error("Every batch stage needs at least one thread and one queue slot");
+    }
+
+    /**
+     * @brief The images of a directory (sorted by name), or the paths listed in a text file, one per line
+     * (relative paths are relative to the list, empty lines and '#' comments are skipped).
+     *
+     * @throw std::runtime_error If the input is neither a directory nor a readable file.
+     */
+    static std::vector<std::filesystem::path> ListInputs(const std::filesystem::path &input)
+    {
+        std::vector<std::filesystem::path> paths;
+        if (std::filesystem::is_directory(input))
+        {
+            for (const auto &entry : std::filesystem::directory_iterator(input))
+                if (entry.is_regular_file() && IsImage(entry.path()))
+                    paths.push_back(entry.path());
+            std::sort(paths.begin(), paths.end());
+            return paths;
+        }
+
+        std::ifstream list(input);
+        if (!list)
+            throw std::runtime_error("Cannot read " + input.string());
+
+        std::string line;
+        while (std::getline(list, line))
+        {
+            line = line.substr(0, line.find('#'));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (line.empty())
+                continue;
+
+            std::filesystem::path path(line);
+            paths.push_back(path.is_relative() ? input.parent_path() / path : path);
+        }
+        return paths;
+    }
+
+    /**
+     * @brief Filter every input into the output directory (created when needed).
+     * The images that cannot be read or written are reported and counted as failed.
+     *
+     * @param inputs The image files.
+     * @param outputDir The directory of the filtered images.
+     * @param filter Filters an image (any backend).
+     * @throw The first exception of a stage (filter, codec), once every thread stopped.
+     */
+    BatchStats Run(const std::vector<std::filesystem::path> &inputs, const std::filesystem::path &outputDir, const FilterFn &filter)
+    {
+        typedef std::chrono::steady_clock clock;
+        const auto start = clock::now();
+
+        std::filesystem::create_directories(outputDir);
+
+        BoundedQueue<Item> decoded(_config.queueDepth);
+        BoundedQueue<Item> filtered(_config.queueDepth);
+
+        BatchStats stats;
+        stats.stages = {{"decode", _config.decodeThreads, 0.0}, {"filter", _config.filterThreads, 0.0}, {"encode", _config.encodeThreads, 0.0}};
+        std::mutex statsMutex;
+        std::atomic<int> failed(0);
+
+        // Busy time of a thread, added to its stage when the thread ends
+        auto account = [&](int stage, double seconds)
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats.stages[stage].busySeconds += seconds;
+        };
+
+        // The last thread of a stage closes its output queue
+        std::atomic<int> decoders(_config.decodeThreads);
+        std::atomic<int> filterers(_config.filterThreads);
+
+        std::atomic<size_t> next(0);
+        auto decode = [&]()
+        {
+            double busy = 0.0;
+            for (size_t i = next++; i < inputs.size(); i = next++)
+            {
+                const auto t0 = clock::now();
+                Item item{inputs[i], cv::imread(inputs[i].string(), cv::IMREAD_COLOR)};
+                busy += std::chrono::duration<double>(clock::now() - t0).count();
+
+                if (item.image.empty())
+                {
+                    std::cout << "[BatchPipeline] Cannot read " << inputs[i].string() << std::endl;
+                    failed++;
+                    continue;
+                }
+                if (!decoded.Push(std::move(item)))
+                    break;
+            }
+            account(0, busy);
+            if (--decoders == 0)
+                decoded.Close();
+        };
+
+        auto filterStage = [&]()
+        {
+            double busy = 0.0;
+            Item item;
+            while (decoded.Pop(item))
+            {
+                const auto t0 = clock::now();
+                cv::Mat output;
+                filter(item.image, output);
+                item.image = output;
+                busy += std::chrono::duration<double>(clock::now() - t0).count();
+
+                if (!filtered.Push(std::move(item)))
+                    break;
+            }
+            account(1, busy);
+            if (--filterers == 0)
+                filtered.Close();
+        };
+
+        auto encode = [&]()
+        {
+            double busy = 0.0;
+            Item item;
+            while (filtered.Pop(item))
+            {
+                const auto t0 = clock::now();
+                const std::filesystem::path output = outputDir / item.path.filename();
+                if (!cv::imwrite(output.string(), item.image))
+                {
+                    std::cout << "[BatchPipeline] Cannot write " << output.string() << std::endl;
+                    failed++;
+                }
+                busy += std::chrono::duration<double>(clock::now() - t0).count();
+            }
+            account(2, busy);
+        };
+
+        // The first exception of any stage closes the queues so the other stages stop, it is rethrown once
+        // every thread is joined
+        std::exception_ptr error;
+        auto guarded = [&](const std::function<void()> &stage)
+        {
+            return [&, stage]()
+            {
+                try
+                {
+                    stage();
+                }
+                catch (...)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(statsMutex);
+                        if (!error)
+                            error = std::current_exception();
+                    }
+                    decoded.Close();
+                    filtered.Close();
+                }
+            };
+        };
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < _config.decodeThreads; ++i)
+            threads.emplace_back(guarded(decode));
+        for (int i = 1; i < _config.filterThreads; ++i)
+            threads.emplace_back(guarded(filterStage));
+        for (int i = 0; i < _config.encodeThreads; ++i)
+            threads.emplace_back(guarded(encode));
+
+        guarded(filterStage)();
+        for (std::thread &thread : threads)
+            thread.join();
+        if (error)
+            std::rethrow_exception(error);
+
+        stats.failed = failed;
+        stats.images = static_cast<int>(inputs.size()) - stats.failed;
+        stats.seconds = std::chrono::duration<double>(clock::now() - start).count();
+        return stats;
+    }
+
+private:
+    struct Item
+    {
+        std::filesystem::path path;
+        cv::Mat image;
+    };
+
+    static bool IsImage(const std::filesystem::path &path)
+    {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+                       { return static_cast<char>(std::tolower(c)); });
+        for (const char *known : {".jpg", ".jpeg", ".png", ".bmp", ".ppm", ".pgm", ".tif", ".tiff", ".webp"})
+            if (extension == known)
+                return true;
+        return false;
+    }
+
+private:
+    BatchConfig _config;
+};
+
+#endif // BatchPipeline_hpp
@@ -0,0 +1,301 @@
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * Settings of a benchmark run.
+ */
+struct BenchmarkConfig
+{
+    // Untimed calls before the measurements (shader compilation, allocations, caches)
+    int warmup = 2;
+    // Timed calls per method and size
+    int iterations = 10;
+    // Upscale factors applied to the original image
+    std::vector<int> factors = {1, 2, 3, 4, 6, 8, 10};
+    // Reports written in addition to the console table (empty = none)
+    std::string csvPath;
+    std::string jsonPath;
+    // Free-form context stored with the results (CPU tier, GL renderer, ...)
+    std::map<std::string, std::string> metadata;
+};
+
+/**
+ * Order statistics of the samples of one method at one size (nanoseconds per frame).
+ */
+struct BenchmarkStats
+{
+    int samples = 0;
+    double min = 0.0;
+    double median = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    // Median absolute deviation from the median
+    double mad = 0.0;
+
+    static BenchmarkStats From(std::vector<double> values)
+    {
+        BenchmarkStats stats;
+        if (values.empty())
+            return stats;
+
+        std::sort(values.begin(), values.end());
+        stats.samples = static_cast<int>(values.size());
+        stats.min = values.front();
+        stats.median = Percentile(values, 0.5);
+        stats.p90 = Percentile(values, 0.9);
+        stats.p99 = Percentile(values, 0.99);
+
+        std::vector<double> deviations;
+        for (double v : values)
+            deviations.push_back(std::abs(v - stats.median));
+        std::sort(deviations.begin(), deviations.end());
+        stats.mad = Percentile(deviations, 0.5);
+
+        return stats;
+    }
+
+private:
+    /**
+     * @brief Linear interpolation between the closest ranks of sorted values.
+     */
+    static double Percentile(const std::vector<double> &sorted, double p)
+    {
+        const double rank = p * (sorted.size() - 1);
+        const size_t lo = static_cast<size_t>(std::floor(rank));
+        const size_t hi = std::min(lo + 1, sorted.size() - 1);
+        return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+    }
+};
+
+/**
+ * Measurements of one method at one size.
+ */
+struct BenchmarkResult
+{
+    std::string method;
+    int factor = 0;
+    int width = 0;
+    int height = 0;
+    BenchmarkStats stats;
+    // Throughput at the median: pixels and bytes (input read + output written) per second
+    double mpixPerSecond = 0.0;
+    double gbPerSecond = 0.0;
+};
+
+/**
+ * Benchmark of the filter backends.
+ *
+ * Methods are registered by name, so every backend (and any future one) is measured the same way:
+ * the original image is upscaled by each factor, each method gets warmup calls and then timed calls,
+ * and the per-frame times are summarized with order statistics (robust to the outliers of a shared machine).
+ */
+class Benchmark
+{
+public:
+    typedef std::function<void(const cv::Mat &input, cv::Mat &output)> FilterFn;
+
+    /**
+     * @brief Register a method.
+     *
+     * @param name The name used in the reports.
+     * @param filter The filter to measure.
+     * @param framesPerCall The number of frames one call processes (the times are reported per frame).
+     */
+    void Add(const std::string &name, FilterFn filter, int framesPerCall = 1)
+    {
+        _methods.push_back({name, filter, framesPerCall});
+    }
+
+    /**
+     * @brief Measure every method at every size, print the table and write the reports.
+     *
+     * @param original The image to upscale and filter.
+     * @param config The settings of the run.
+     * @return The measurements, by size then method.
+     */
+    std::vector<BenchmarkResult> Run(const cv::Mat &original, const BenchmarkConfig &config) const
+    {
+        typedef std::chrono::steady_clock clock;
+
+        std::vector<BenchmarkResult> results;
+        cv::Mat input, output;
+        for (int factor : config.factors)
+        {
+            cv::resize(original, input, cv::Size(factor * original.cols, factor * original.rows));
+
+            for (const Method &method : _methods)
+            {
+                for (int i = 0; i < config.warmup; ++i)
+                    method.filter(input, output);
+
+                std::vector<double> samples;
+                for (int i = 0; i < config.iterations; ++i)
+                {
+                    auto t0 = clock::now();
+                    method.filter(input, output);
+                    auto t1 = clock::now();
+                    samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() / method.framesPerCall);
+                }
+
+                BenchmarkResult result;
+                result.method = method.name;
+                result.factor = factor;
+                result.width = input.cols;
+                result.height = input.rows;
+                result.stats = BenchmarkStats::From(samples);
+                if (result.stats.median > 0.0)
+                {
+                    const double pixels = static_cast<double>(input.cols) * input.rows;
+                    const double bytes = 2.0 * pixels * input.elemSize();
+                    result.mpixPerSecond = pixels / result.stats.median * 1e3;
+                    result.gbPerSecond = bytes / result.stats.median;
+                }
+                results.push_back(result);
+            }
+        }
+
+        PrintTable(results, std::cout);
+        if (!config.csvPath.empty())
+            WriteCSV(results, config, config.csvPath);
+        if (!config.jsonPath.empty())
+            WriteJSON(results, config, config.jsonPath);
+
+        return results;
+    }
+
+    /**
+     * @brief Print the results as a tab separated table (times in ms).
+     */
+    static void PrintTable(const std::vector<BenchmarkResult> &results, std::ostream &out)
+    {
+        const std::ios_base::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+
+        out << "Method\tFactor\tSize\tMedian\tP90\tP99\tMin\tMAD\tMPix/s\tGB/s" << std::endl;
+        out << std::fixed << std::setprecision(3);
+        for (const BenchmarkResult &r : results)
+        {
+            out << r.method << "\t" << r.factor << "\t" << r.width << "x" << r.height << "\t"
+                << r.stats.median * 1e-6 << "\t" << r.stats.p90 * 1e-6 << "\t" << r.stats.p99 * 1e-6 << "\t"
+                << r.stats.min * 1e-6 << "\t" << r.stats.mad * 1e-6 << "\t"
+                << r.mpixPerSecond << "\t" << r.gbPerSecond << std::endl;
+        }
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    /**
+     * @brief Write one line per method and size (times in ns), the metadata as leading comments.
+     */
+    static void WriteCSV(const std::vector<BenchmarkResult> &results, const BenchmarkConfig &config, const std::string &path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "[Benchmark] Cannot write " << path << std::endl;
+            return;
+        }
+
+        for (const auto &[key, value] : config.metadata)
+            file << "# " << key << ": " << value << "\n";
+        file << "# warmup: " << config.warmup << "\n# iterations: " << config.iterations << "\n";
+
+        file << "method,factor,width,height,samples,min_ns,median_ns,p90_ns,p99_ns,mad_ns,mpix_per_s,gb_per_s\n";
+        file << std::setprecision(10);
+        for (const BenchmarkResult &r : results)
+        {
+            file << r.method << "," << r.factor << "," << r.width << "," << r.height << ","
+                 << r.stats.samples << "," << r.stats.min << "," << r.stats.median << ","
+                 << r.stats.p90 << "," << r.stats.p99 << "," << r.stats.mad << ","
+                 << r.mpixPerSecond << "," << r.gbPerSecond << "\n";
+        }
+
+        std::cout << "[Benchmark] Written : " << path << std::endl;
+    }
+
+    /**
+     * @brief Write the configuration, the metadata and the results (times in ns).
+     */
+    static void WriteJSON(const std::vector<BenchmarkResult> &results, const BenchmarkConfig &config, const std::string &path)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            std::cout << "[Benchmark] Cannot write " << path << std::endl;
+            return;
+        }
+
+        file << std::setprecision(10);
+        file << "{\n  \"metadata\": {";
+        bool first = true;
+        for (const auto &[key, value] : config.metadata)
+        {
+            file << (first ? "\n" : ",\n") << "    " << Quote(key) << ": " << Quote(value);
+            first = false;
+        }
+        file << "\n  },\n";
+        file << "  \"warmup\": " << config.warmup << ",\n";
+        file << "  \"iterations\": " << config.iterations << ",\n";
+        file << "  \"results\": [";
+
+        first = true;
+        for (const BenchmarkResult &r : results)
+        {
+            file << (first ? "\n" : ",\n");
+            file << "    {\"method\": " << Quote(r.method) << ", \"factor\": " << r.factor
+                 << ", \"width\": " << r.width << ", \"height\": " << r.height
+                 << ", \"samples\": " << r.stats.samples << ", \"min_ns\": " << r.stats.min
+                 << ", \"median_ns\": " << r.stats.median << ", \"p90_ns\": " << r.stats.p90
+                 << ", \"p99_ns\": " << r.stats.p99 << ", \"mad_ns\": " << r.stats.mad
+                 << ", \"mpix_per_s\": " << r.mpixPerSecond << ", \"gb_per_s\": " << r.gbPerSecond << "}";
+            first = false;
+        }
+        file << "\n  ]\n}\n";
+
+        std::cout << "[Benchmark] Written : " << path << std::endl;
+    }
+
+private:
+    struct Method
+    {
+        std::string name;
+        FilterFn filter;
+        int framesPerCall;
+    };
+
+    static std::string Quote(const std::string &text)
+    {
+        std::ostringstream out;
+        out << '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if (static_cast<unsigned char>(c) < 0x20)
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+            else
+                out << c;
+        }
+        out << '"';
+        return out.str();
+    }
+
+private:
+    std::vector<Method> _methods;
+};
+
+#endif // Benchmark_hpp
@@ -0,0 +1,126 @@
+#ifndef BoundedQueue_hpp
+#define BoundedQueue_hpp
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/**
+ * Blocking FIFO of a fixed capacity between the threads of two pipeline stages.
+ *
+ * Push() waits while the queue is full, so a fast producer cannot run ahead of its consumer by more than
+ * the capacity (the memory of the images in flight is bounded). Pop() waits while it is empty. Once
+ * closed, Push() refuses the items and Pop() drains the remaining ones, then returns false.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : _capacity(capacity > 0 ? capacity : 1), _closed(false) {}
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /**
+     * @brief Append an item, waiting for room.
+     *
+     * @return false if the queue is closed (the item is dropped).
+     */
+    bool Push(T item)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notFull.wait(lock, [this]()
+                      { return _closed || _items.size() < _capacity; });
+        if (_closed)
+            return false;
+
+        _items.push_back(std::move(item));
+        lock.unlock();
+        _notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Append an item if there is room, without waiting.
+     *
+     * @return false if the queue is full or closed (the item is left untouched).
+     */
+    bool TryPush(T &&item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_closed || _items.size() >= _capacity)
+                return false;
+            _items.push_back(std::move(item));
+        }
+        _notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest item, waiting for one.
+     *
+     * @return false if the queue is closed and empty.
+     */
+    bool Pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notEmpty.wait(lock, [this]()
+                       { return _closed || !_items.empty(); });
+        if (_items.empty())
+            return false;
+
+        item = std::move(_items.front());
+        _items.pop_front();
+        lock.unlock();
+        _notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest item if there is one, without waiting.
+     */
+    bool TryPop(T &item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_items.empty())
+                return false;
+            item = std::move(_items.front());
+            _items.pop_front();
+        }
+        _notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief No more items: wake every waiting thread.
+     */
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+        }
+        _notFull.notify_all();
+        _notEmpty.notify_all();
+    }
+
+    bool Closed()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _closed;
+    }
+
+private:
+    size_t _capacity;
+    bool _closed;
+    std::deque<T> _items;
+    std::mutex _mutex;
+    std::condition_variable _notFull;
+    std::condition_variable _notEmpty;
+};
+
+#endif // BoundedQueue_hpp
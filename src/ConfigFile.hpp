@@ -0,0 +1,97 @@
+#ifndef ConfigFile_hpp
+#define ConfigFile_hpp
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+/**
+ * Small text file of per-machine settings, one entry per line, '#' starts a comment.
+ *
+ * Location: the file named by an environment variable, else $XDG_CONFIG_HOME/gl-compute/NAME, else
+ * ~/.config/gl-compute/NAME. No location (empty path) is never read nor written.
+ */
+class ConfigFile
+{
+public:
+    typedef std::function<void(std::istringstream &fields)> ReadFn;
+    typedef std::function<void(std::ostream &file)> WriteFn;
+
+    /**
+     * @param variable The environment variable overriding the location.
+     * @param name The name of the file in the gl-compute configuration directory.
+     * @param owner The name logged with the messages.
+     */
+    ConfigFile(const char *variable, const std::string &name, const std::string &owner) : _path(DefaultPath(variable, name)), _owner(owner) {}
+
+    ConfigFile(const std::filesystem::path &path, const std::string &owner) : _path(path), _owner(owner) {}
+
+    const std::filesystem::path &Path() const { return _path; }
+
+    /**
+     * @brief Call read with the fields of every line, comments removed. A missing file has no line.
+     */
+    void Read(const ReadFn &read) const
+    {
+        if (_path.empty())
+            return;
+
+        std::ifstream file(_path);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line.substr(0, line.find('#')));
+            read(fields);
+        }
+    }
+
+    /**
+     * @brief Replace the file with a header comment and the lines of write (the directory is created when needed).
+     *
+     * @return false if the file cannot be written.
+     */
+    bool Write(const std::string &header, const WriteFn &write) const
+    {
+        if (_path.empty())
+            return false;
+
+        std::error_code error;
+        if (_path.has_parent_path())
+            std::filesystem::create_directories(_path.parent_path(), error);
+
+        std::ofstream file(_path);
+        if (!file)
+        {
+            std::cout << "[" << _owner << "] Cannot write " << _path.string() << std::endl;
+            return false;
+        }
+
+        file << "# " << header << "\n";
+        write(file);
+
+        std::cout << "[" << _owner << "] Written : " << _path.string() << std::endl;
+        return true;
+    }
+
+private:
+    static std::filesystem::path DefaultPath(const char *variable, const std::string &name)
+    {
+        if (const char *file = std::getenv(variable))
+            return file;
+        if (const char *xdg = std::getenv("XDG_CONFIG_HOME"); xdg != nullptr && *xdg != '\0')
+            return std::filesystem::path(xdg) / "gl-compute" / name;
+        if (const char *home = std::getenv("HOME"))
+            return std::filesystem::path(home) / ".config" / "gl-compute" / name;
+        return {};
+    }
+
+private:
+    std::filesystem::path _path;
+    std::string _owner;
+};
+
+#endif // ConfigFile_hpp
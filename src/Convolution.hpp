@@ -0,0 +1,159 @@
+#ifndef Convolution_hpp
+#define Convolution_hpp
+
+#include <cstdint>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "ConvolutionKernels.hpp"
+#include "CpuDispatch.hpp"
+#include "Kernel.hpp"
+
+/**
+ * Row kernels for a square convolution on interleaved 8-bit images.
+ *
+ * A row is handled as a flat byte array: the horizontal neighbours of the byte at index i
+ * are at i - cn, i + cn, ... (cn = number of channels), so the same code serves every channel.
+ * The vectorized kernels are compiled once per instruction set (see ConvolutionKernels.hpp),
+ * the variant is picked at startup from cpuid and can be lowered through GL_COMPUTE_CPU_ISA.
+ */
+
+/**
+ * @brief Reference row kernel (see ConvolutionKernels.hpp for the parameters).
+ */
+inline void ConvolveRowScalar(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias)
+{
+    const int radius = size / 2;
+    for (int i = begin; i < end; ++i)
+    {
+        float sum = 0.0f;
+        for (int ky = 0; ky < size; ++ky)
+            for (int kx = 0; kx < size; ++kx)
+                sum += rows[ky][i + (kx - radius) * cn] * weights[ky * size + kx];
+        dst[i] = cv::saturate_cast<uchar>(sum * scale + bias);
+    }
+}
+
+/**
+ * @brief Reference horizontal pass (see ConvolutionKernels.hpp for the parameters).
+ */
+inline void ConvolveHorizontalScalar(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[])
+{
+    const int radius = size / 2;
+    for (int i = begin; i < end; ++i)
+    {
+        float sum = 0.0f;
+        for (int kx = 0; kx < size; ++kx)
+            sum += src[i + (kx - radius) * cn] * weights[kx];
+        dst[i] = sum;
+    }
+}
+
+/**
+ * @brief Reference vertical pass (see ConvolutionKernels.hpp for the parameters).
+ */
+inline void ConvolveVerticalScalar(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        float sum = 0.0f;
+        for (int ky = 0; ky < size; ++ky)
+            sum += rows[ky][i] * weights[ky];
+        dst[i] = cv::saturate_cast<uchar>(sum * scale + bias);
+    }
+}
+
+/**
+ * The kernels of an instruction set tier.
+ */
+struct ConvolutionFns
+{
+    ConvolveRowFn row;
+    ConvolveHorizontalFn horizontal;
+    ConvolveVerticalFn vertical;
+};
+
+/**
+ * @brief Get the kernels of an instruction set tier.
+ */
+inline ConvolutionFns GetConvolutionFns(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CpuIsa::AVX512:
+        return {ConvolveRowAVX512, ConvolveHorizontalAVX512, ConvolveVerticalAVX512};
+    case CpuIsa::AVX2:
+        return {ConvolveRowAVX2, ConvolveHorizontalAVX2, ConvolveVerticalAVX2};
+    case CpuIsa::SSE41:
+        return {ConvolveRowSSE41, ConvolveHorizontalSSE41, ConvolveVerticalSSE41};
+    case CpuIsa::SSE2:
+        return {ConvolveRowSSE2, ConvolveHorizontalSSE2, ConvolveVerticalSSE2};
+    default:
+        return {ConvolveRowScalar, ConvolveHorizontalScalar, ConvolveVerticalScalar};
+    }
+}
+
+/**
+ * @brief The instruction set tier used by the CPU filter (selected once per process).
+ */
+inline CpuIsa ActiveCpuIsa()
+{
+    static const CpuIsa isa = SelectCpuIsa();
+    return isa;
+}
+
+/**
+ * @brief The kernels of the active tier.
+ */
+inline const ConvolutionFns &ActiveConvolutionFns()
+{
+    static const ConvolutionFns fns = GetConvolutionFns(ActiveCpuIsa());
+    return fns;
+}
+
+/**
+ * @brief Convolve one row with the kernel of the active tier.
+ *
+ * @param rows The kernel.size source rows centered on the destination row.
+ * @param dst The destination row.
+ * @param begin First byte to compute (must be >= kernel.Radius() * cn).
+ * @param end One past the last byte to compute (must be <= row bytes - kernel.Radius() * cn).
+ * @param cn The number of interleaved channels.
+ * @param kernel The kernel.
+ */
+inline void ConvolveRow(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, const Kernel &kernel)
+{
+    ActiveConvolutionFns().row(rows, dst, begin, end, cn, kernel.size, kernel.weights.data(), kernel.Scale(), kernel.bias);
+}
+
+/**
+ * @brief Horizontal pass of a separable kernel on one row, with the kernel of the active tier.
+ *
+ * @param src The source row.
+ * @param dst The unscaled sums (same indexing as the source bytes).
+ * @param begin First byte to compute (must be >= radius * cn).
+ * @param end One past the last byte to compute (must be <= row bytes - radius * cn).
+ * @param cn The number of interleaved channels.
+ * @param row The row factor of the kernel.
+ */
+inline void ConvolveHorizontal(const uint8_t *src, float *dst, int begin, int end, int cn, const std::vector<float> &row)
+{
+    ActiveConvolutionFns().horizontal(src, dst, begin, end, cn, static_cast<int>(row.size()), row.data());
+}
+
+/**
+ * @brief Vertical pass of a separable kernel on one row, with the kernel of the active tier.
+ *
+ * @param rows The horizontal sums of the column.size() rows centered on the destination row.
+ * @param dst The destination row.
+ * @param begin First byte to compute.
+ * @param end One past the last byte to compute.
+ * @param column The column factor of the kernel.
+ * @param kernel The kernel (scale and bias).
+ */
+inline void ConvolveVertical(const float *const rows[], uint8_t *dst, int begin, int end, const std::vector<float> &column, const Kernel &kernel)
+{
+    ActiveConvolutionFns().vertical(rows, dst, begin, end, static_cast<int>(column.size()), column.data(), kernel.Scale(), kernel.bias);
+}
+
+#endif // Convolution_hpp
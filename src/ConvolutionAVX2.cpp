@@ -0,0 +1,7 @@
+// Compiled with -mavx2 (see src/CMakeLists.txt)
+#if !defined(__AVX2__)
+#error "ConvolutionAVX2.cpp must be compiled with __AVX2__ enabled"
+#endif
+
+#define CONVOLUTION_ISA(name) name##AVX2
+#include "ConvolutionKernels.inl"
@@ -0,0 +1,12 @@
+// Compiled with -mavx512f (see src/CMakeLists.txt)
+#if !defined(__AVX512F__)
+#error "ConvolutionAVX512.cpp must be compiled with __AVX512F__ enabled"
+#endif
+
+// GCC 12 reports the _mm512_undefined_* placeholders inside the intrinsics as maybe-uninitialized at -O2
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define CONVOLUTION_ISA(name) name##AVX512
+#include "ConvolutionKernels.inl"
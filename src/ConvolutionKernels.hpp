@@ -0,0 +1,78 @@
+#ifndef ConvolutionKernels_hpp
+#define ConvolutionKernels_hpp
+
+#include <cstdint>
+
+/**
+ * Entry points of the vectorized convolution kernels.
+ *
+ * Each kernel lives in its own translation unit (ConvolutionSSE2.cpp, ConvolutionAVX2.cpp, ...) that compiles
+ * ConvolutionKernels.inl with the matching ISA flags (see src/CMakeLists.txt). Only these declarations are shared:
+ * anything inline included by those units would be compiled with their flags and could leak into the baseline code.
+ */
+
+/**
+ * @brief Signature of a row kernel.
+ *
+ * For each byte i in [begin, end): dst[i] = saturate(sum(weights[ky * size + kx] * rows[ky][i + (kx - size / 2) * cn]) * scale + bias)
+ *
+ * @param rows The size source rows centered on the destination row (rows[size / 2] is the same row).
+ * @param dst The destination row.
+ * @param begin First byte to compute (must be >= (size / 2) * cn).
+ * @param end One past the last byte to compute (must be <= row bytes - (size / 2) * cn).
+ * @param cn The number of interleaved channels.
+ * @param size The kernel width and height (odd).
+ * @param weights The size * size weights in row-major order.
+ * @param scale The factor applied to the weighted sum.
+ * @param bias The value added after scaling.
+ */
+typedef void (*ConvolveRowFn)(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias);
+
+/**
+ * @brief Signature of a horizontal pass (first pass of a separable kernel).
+ *
+ * For each byte i in [begin, end): dst[i] = sum(weights[kx] * src[i + (kx - size / 2) * cn])
+ *
+ * @param src The source row.
+ * @param dst The destination row (unscaled sums).
+ * @param begin First byte to compute (must be >= (size / 2) * cn).
+ * @param end One past the last byte to compute (must be <= row bytes - (size / 2) * cn).
+ * @param cn The number of interleaved channels.
+ * @param size The number of taps (odd).
+ * @param weights The row factor of the kernel.
+ */
+typedef void (*ConvolveHorizontalFn)(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[]);
+
+/**
+ * @brief Signature of a vertical pass (second pass of a separable kernel).
+ *
+ * For each index i in [begin, end): dst[i] = saturate(sum(weights[ky] * rows[ky][i]) * scale + bias)
+ *
+ * @param rows The size rows of the horizontal pass centered on the destination row.
+ * @param dst The destination row.
+ * @param begin First index to compute.
+ * @param end One past the last index to compute.
+ * @param size The number of taps (odd).
+ * @param weights The column factor of the kernel.
+ * @param scale The factor applied to the weighted sum.
+ * @param bias The value added after scaling.
+ */
+typedef void (*ConvolveVerticalFn)(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias);
+
+void ConvolveRowSSE2(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias);
+void ConvolveHorizontalSSE2(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[]);
+void ConvolveVerticalSSE2(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias);
+
+void ConvolveRowSSE41(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias);
+void ConvolveHorizontalSSE41(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[]);
+void ConvolveVerticalSSE41(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias);
+
+void ConvolveRowAVX2(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias);
+void ConvolveHorizontalAVX2(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[]);
+void ConvolveVerticalAVX2(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias);
+
+void ConvolveRowAVX512(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias);
+void ConvolveHorizontalAVX512(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[]);
+void ConvolveVerticalAVX512(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias);
+
+#endif // ConvolutionKernels_hpp
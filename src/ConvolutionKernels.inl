@@ -0,0 +1,490 @@
+// Body of the vectorized row kernels.
+//
+// Included once per ISA translation unit, which defines CONVOLUTION_ISA(name) (appending its suffix) and is compiled with the
+// matching flags. The widest instruction set enabled by those flags selects the implementation below.
+// Everything except the entry points has internal linkage so no ISA-specific code can be shared across units.
+//
+// Each output byte is computed exactly like the reference implementation (ConvolveRowScalar):
+//    sum = 0; sum += p * w for the size * size taps in row-major order; saturate_cast<uchar>(sum * scale + bias)
+// The vector paths keep that accumulation order, round to nearest even like cvRound and saturate to [0, 255],
+// so they are bit-exact with the scalar path. The units are built with -ffp-contract=off so no FMA is formed.
+// The passes of separable kernels (ConvolveHorizontal / ConvolveVertical) follow the same rule with their
+// references (ConvolveHorizontalScalar / ConvolveVerticalScalar).
+//
+// The common sizes (3, 5 and 7) are instantiated with a compile time size so their tap loops are fully unrolled.
+
+#ifndef CONVOLUTION_ISA
+#error "Define CONVOLUTION_ISA(name) before including ConvolutionKernels.inl"
+#endif
+
+#include <cstdint>
+#include <immintrin.h>
+#include <type_traits>
+
+#include "ConvolutionKernels.hpp"
+
+namespace
+{
+    /**
+     * @brief Same rounding as cv::saturate_cast<uchar>(float) on x86-64 (cvRound uses cvtss2si).
+     */
+    inline uint8_t SaturateU8(float value)
+    {
+        const int v = _mm_cvtss_si32(_mm_set_ss(value));
+        return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+
+    /**
+     * @brief Scalar tail for the bytes that do not fill a whole vector.
+     */
+    inline void ConvolveTail(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias)
+    {
+        const int radius = size / 2;
+        for (int i = begin; i < end; ++i)
+        {
+            float sum = 0.0f;
+            for (int ky = 0; ky < size; ++ky)
+                for (int kx = 0; kx < size; ++kx)
+                    sum += rows[ky][i + (kx - radius) * cn] * weights[ky * size + kx];
+            dst[i] = SaturateU8(sum * scale + bias);
+        }
+    }
+
+    inline void HorizontalTail(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[])
+    {
+        const int radius = size / 2;
+        for (int i = begin; i < end; ++i)
+        {
+            float sum = 0.0f;
+            for (int kx = 0; kx < size; ++kx)
+                sum += src[i + (kx - radius) * cn] * weights[kx];
+            dst[i] = sum;
+        }
+    }
+
+    inline void VerticalTail(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            float sum = 0.0f;
+            for (int ky = 0; ky < size; ++ky)
+                sum += rows[ky][i] * weights[ky];
+            dst[i] = SaturateU8(sum * scale + bias);
+        }
+    }
+
+    /**
+     * @brief Call f with the size as a compile time constant for the common sizes, 0 (runtime size) otherwise.
+     */
+    template <typename F>
+    inline void WithSize(int size, F f)
+    {
+        switch (size)
+        {
+        case 3:
+            f(std::integral_constant<int, 3>());
+            break;
+        case 5:
+            f(std::integral_constant<int, 5>());
+            break;
+        case 7:
+            f(std::integral_constant<int, 7>());
+            break;
+        default:
+            f(std::integral_constant<int, 0>());
+            break;
+        }
+    }
+}
+
+#if defined(__AVX512F__)
+
+namespace
+{
+    // 64 bytes per iteration
+    template <int N>
+    void RowKernel(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias)
+    {
+        const int n = N > 0 ? N : size;
+        const int radius = n / 2;
+        const __m512 vscale = _mm512_set1_ps(scale);
+        const __m512 vbias = _mm512_set1_ps(bias);
+        const __m512i zero = _mm512_setzero_si512();
+
+        int i = begin;
+        for (; i + 64 <= end; i += 64)
+        {
+            __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+
+            for (int ky = 0; ky < n; ++ky)
+            {
+                for (int kx = 0; kx < n; ++kx)
+                {
+                    const __m512 w = _mm512_set1_ps(weights[ky * n + kx]);
+                    const uint8_t *src = rows[ky] + i + (kx - radius) * cn;
+                    for (int q = 0; q < 4; ++q)
+                    {
+                        const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16 * q));
+                        acc[q] = _mm512_add_ps(acc[q], _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(px)), w));
+                    }
+                }
+            }
+
+            // Clamp negatives (and the INT_MIN of out of range values) to 0, then saturate the top at 255
+            for (int q = 0; q < 4; ++q)
+            {
+                const __m512 value = _mm512_add_ps(_mm512_mul_ps(acc[q], vscale), vbias);
+                const __m512i v = _mm512_max_epi32(_mm512_cvtps_epi32(value), zero);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 16 * q), _mm512_cvtusepi32_epi8(v));
+            }
+        }
+
+        ConvolveTail(rows, dst, i, end, cn, n, weights, scale, bias);
+    }
+
+    template <int N>
+    void HorizontalKernel(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[])
+    {
+        const int n = N > 0 ? N : size;
+        const int radius = n / 2;
+
+        int i = begin;
+        for (; i + 64 <= end; i += 64)
+        {
+            __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+            for (int kx = 0; kx < n; ++kx)
+            {
+                const __m512 w = _mm512_set1_ps(weights[kx]);
+                const uint8_t *p = src + i + (kx - radius) * cn;
+                for (int q = 0; q < 4; ++q)
+                {
+                    const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * q));
+                    acc[q] = _mm512_add_ps(acc[q], _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(px)), w));
+                }
+            }
+            for (int q = 0; q < 4; ++q)
+                _mm512_storeu_ps(dst + i + 16 * q, acc[q]);
+        }
+
+        HorizontalTail(src, dst, i, end, cn, n, weights);
+    }
+
+    template <int N>
+    void VerticalKernel(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias)
+    {
+        const int n = N > 0 ? N : size;
+        const __m512 vscale = _mm512_set1_ps(scale);
+        const __m512 vbias = _mm512_set1_ps(bias);
+        const __m512i zero = _mm512_setzero_si512();
+
+        int i = begin;
+        for (; i + 64 <= end; i += 64)
+        {
+            __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps(), _mm512_setzero_ps()};
+            for (int ky = 0; ky < n; ++ky)
+            {
+                const __m512 w = _mm512_set1_ps(weights[ky]);
+                for (int q = 0; q < 4; ++q)
+                    acc[q] = _mm512_add_ps(acc[q], _mm512_mul_ps(_mm512_loadu_ps(rows[ky] + i + 16 * q), w));
+            }
+
+            for (int q = 0; q < 4; ++q)
+            {
+                const __m512 value = _mm512_add_ps(_mm512_mul_ps(acc[q], vscale), vbias);
+                const __m512i v = _mm512_max_epi32(_mm512_cvtps_epi32(value), zero);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 16 * q), _mm512_cvtusepi32_epi8(v));
+            }
+        }
+
+        VerticalTail(rows, dst, i, end, n, weights, scale, bias);
+    }
+}
+
+#elif defined(__AVX2__)
+
+namespace
+{
+    // 32 bytes per iteration
+    template <int N>
+    void RowKernel(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias)
+    {
+        const int n = N > 0 ? N : size;
+        const int radius = n / 2;
+        const __m256 vscale = _mm256_set1_ps(scale);
+        const __m256 vbias = _mm256_set1_ps(bias);
+
+        // The 128-bit packs interleave the lanes, this puts the dwords back in order
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+        int i = begin;
+        for (; i + 32 <= end; i += 32)
+        {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            __m256 acc2 = _mm256_setzero_ps();
+            __m256 acc3 = _mm256_setzero_ps();
+
+            for (int ky = 0; ky < n; ++ky)
+            {
+                for (int kx = 0; kx < n; ++kx)
+                {
+                    const __m256 w = _mm256_set1_ps(weights[ky * n + kx]);
+                    const uint8_t *src = rows[ky] + i + (kx - radius) * cn;
+                    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+                    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+
+                    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(lo)), w));
+                    acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8))), w));
+                    acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(hi)), w));
+                    acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8))), w));
+                }
+            }
+
+            acc0 = _mm256_add_ps(_mm256_mul_ps(acc0, vscale), vbias);
+            acc1 = _mm256_add_ps(_mm256_mul_ps(acc1, vscale), vbias);
+            acc2 = _mm256_add_ps(_mm256_mul_ps(acc2, vscale), vbias);
+            acc3 = _mm256_add_ps(_mm256_mul_ps(acc3, vscale), vbias);
+
+            const __m256i lo = _mm256_packs_epi32(_mm256_cvtps_epi32(acc0), _mm256_cvtps_epi32(acc1));
+            const __m256i hi = _mm256_packs_epi32(_mm256_cvtps_epi32(acc2), _mm256_cvtps_epi32(acc3));
+            const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), order);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+        }
+
+        ConvolveTail(rows, dst, i, end, cn, n, weights, scale, bias);
+    }
+
+    template <int N>
+    void HorizontalKernel(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[])
+    {
+        const int n = N > 0 ? N : size;
+        const int radius = n / 2;
+
+        int i = begin;
+        for (; i + 32 <= end; i += 32)
+        {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            __m256 acc2 = _mm256_setzero_ps();
+            __m256 acc3 = _mm256_setzero_ps();
+
+            for (int kx = 0; kx < n; ++kx)
+            {
+                const __m256 w = _mm256_set1_ps(weights[kx]);
+                const uint8_t *p = src + i + (kx - radius) * cn;
+                const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+
+                acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(lo)), w));
+                acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8))), w));
+                acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(hi)), w));
+                acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8))), w));
+            }
+
+            _mm256_storeu_ps(dst + i, acc0);
+            _mm256_storeu_ps(dst + i + 8, acc1);
+            _mm256_storeu_ps(dst + i + 16, acc2);
+            _mm256_storeu_ps(dst + i + 24, acc3);
+        }
+
+        HorizontalTail(src, dst, i, end, cn, n, weights);
+    }
+
+    template <int N>
+    void VerticalKernel(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias)
+    {
+        const int n = N > 0 ? N : size;
+        const __m256 vscale = _mm256_set1_ps(scale);
+        const __m256 vbias = _mm256_set1_ps(bias);
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+        int i = begin;
+        for (; i + 32 <= end; i += 32)
+        {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            __m256 acc2 = _mm256_setzero_ps();
+            __m256 acc3 = _mm256_setzero_ps();
+
+            for (int ky = 0; ky < n; ++ky)
+            {
+                const __m256 w = _mm256_set1_ps(weights[ky]);
+                const float *p = rows[ky] + i;
+                acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(p), w));
+                acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(p + 8), w));
+                acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(_mm256_loadu_ps(p + 16), w));
+                acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(_mm256_loadu_ps(p + 24), w));
+            }
+
+            acc0 = _mm256_add_ps(_mm256_mul_ps(acc0, vscale), vbias);
+            acc1 = _mm256_add_ps(_mm256_mul_ps(acc1, vscale), vbias);
+            acc2 = _mm256_add_ps(_mm256_mul_ps(acc2, vscale), vbias);
+            acc3 = _mm256_add_ps(_mm256_mul_ps(acc3, vscale), vbias);
+
+            const __m256i lo = _mm256_packs_epi32(_mm256_cvtps_epi32(acc0), _mm256_cvtps_epi32(acc1));
+            const __m256i hi = _mm256_packs_epi32(_mm256_cvtps_epi32(acc2), _mm256_cvtps_epi32(acc3));
+            const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), order);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+        }
+
+        VerticalTail(rows, dst, i, end, n, weights, scale, bias);
+    }
+}
+
+#else
+
+// SSE2 / SSE4.1: 16 bytes per iteration
+namespace
+{
+    /**
+     * @brief Widen the bytes [4q, 4q + 4) of px to floats.
+     */
+    template <int q>
+    inline __m128 Widen(__m128i px)
+    {
+#if defined(__SSE4_1__)
+        return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(px, 4 * q)));
+#else
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i words = (q < 2) ? _mm_unpacklo_epi8(px, zero) : _mm_unpackhi_epi8(px, zero);
+        const __m128i dwords = (q % 2 == 0) ? _mm_unpacklo_epi16(words, zero) : _mm_unpackhi_epi16(words, zero);
+        return _mm_cvtepi32_ps(dwords);
+#endif
+    }
+
+    template <int N>
+    void RowKernel(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias)
+    {
+        const int n = N > 0 ? N : size;
+        const int radius = n / 2;
+        const __m128 vscale = _mm_set1_ps(scale);
+        const __m128 vbias = _mm_set1_ps(bias);
+
+        int i = begin;
+        for (; i + 16 <= end; i += 16)
+        {
+            __m128 acc0 = _mm_setzero_ps();
+            __m128 acc1 = _mm_setzero_ps();
+            __m128 acc2 = _mm_setzero_ps();
+            __m128 acc3 = _mm_setzero_ps();
+
+            for (int ky = 0; ky < n; ++ky)
+            {
+                for (int kx = 0; kx < n; ++kx)
+                {
+                    const __m128 w = _mm_set1_ps(weights[ky * n + kx]);
+                    const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows[ky] + i + (kx - radius) * cn));
+
+                    acc0 = _mm_add_ps(acc0, _mm_mul_ps(Widen<0>(px), w));
+                    acc1 = _mm_add_ps(acc1, _mm_mul_ps(Widen<1>(px), w));
+                    acc2 = _mm_add_ps(acc2, _mm_mul_ps(Widen<2>(px), w));
+                    acc3 = _mm_add_ps(acc3, _mm_mul_ps(Widen<3>(px), w));
+                }
+            }
+
+            acc0 = _mm_add_ps(_mm_mul_ps(acc0, vscale), vbias);
+            acc1 = _mm_add_ps(_mm_mul_ps(acc1, vscale), vbias);
+            acc2 = _mm_add_ps(_mm_mul_ps(acc2, vscale), vbias);
+            acc3 = _mm_add_ps(_mm_mul_ps(acc3, vscale), vbias);
+
+            // Round to nearest even, then saturate to [0, 255] through int16
+            const __m128i lo = _mm_packs_epi32(_mm_cvtps_epi32(acc0), _mm_cvtps_epi32(acc1));
+            const __m128i hi = _mm_packs_epi32(_mm_cvtps_epi32(acc2), _mm_cvtps_epi32(acc3));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+
+        ConvolveTail(rows, dst, i, end, cn, n, weights, scale, bias);
+    }
+
+    template <int N>
+    void HorizontalKernel(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[])
+    {
+        const int n = N > 0 ? N : size;
+        const int radius = n / 2;
+
+        int i = begin;
+        for (; i + 16 <= end; i += 16)
+        {
+            __m128 acc0 = _mm_setzero_ps();
+            __m128 acc1 = _mm_setzero_ps();
+            __m128 acc2 = _mm_setzero_ps();
+            __m128 acc3 = _mm_setzero_ps();
+
+            for (int kx = 0; kx < n; ++kx)
+            {
+                const __m128 w = _mm_set1_ps(weights[kx]);
+                const __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + (kx - radius) * cn));
+
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(Widen<0>(px), w));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(Widen<1>(px), w));
+                acc2 = _mm_add_ps(acc2, _mm_mul_ps(Widen<2>(px), w));
+                acc3 = _mm_add_ps(acc3, _mm_mul_ps(Widen<3>(px), w));
+            }
+
+            _mm_storeu_ps(dst + i, acc0);
+            _mm_storeu_ps(dst + i + 4, acc1);
+            _mm_storeu_ps(dst + i + 8, acc2);
+            _mm_storeu_ps(dst + i + 12, acc3);
+        }
+
+        HorizontalTail(src, dst, i, end, cn, n, weights);
+    }
+
+    template <int N>
+    void VerticalKernel(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias)
+    {
+        const int n = N > 0 ? N : size;
+        const __m128 vscale = _mm_set1_ps(scale);
+        const __m128 vbias = _mm_set1_ps(bias);
+
+        int i = begin;
+        for (; i + 16 <= end; i += 16)
+        {
+            __m128 acc0 = _mm_setzero_ps();
+            __m128 acc1 = _mm_setzero_ps();
+            __m128 acc2 = _mm_setzero_ps();
+            __m128 acc3 = _mm_setzero_ps();
+
+            for (int ky = 0; ky < n; ++ky)
+            {
+                const __m128 w = _mm_set1_ps(weights[ky]);
+                const float *p = rows[ky] + i;
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(p), w));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(p + 4), w));
+                acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(p + 8), w));
+                acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(p + 12), w));
+            }
+
+            acc0 = _mm_add_ps(_mm_mul_ps(acc0, vscale), vbias);
+            acc1 = _mm_add_ps(_mm_mul_ps(acc1, vscale), vbias);
+            acc2 = _mm_add_ps(_mm_mul_ps(acc2, vscale), vbias);
+            acc3 = _mm_add_ps(_mm_mul_ps(acc3, vscale), vbias);
+
+            const __m128i lo = _mm_packs_epi32(_mm_cvtps_epi32(acc0), _mm_cvtps_epi32(acc1));
+            const __m128i hi = _mm_packs_epi32(_mm_cvtps_epi32(acc2), _mm_cvtps_epi32(acc3));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+
+        VerticalTail(rows, dst, i, end, n, weights, scale, bias);
+    }
+}
+
+#endif
+
+void CONVOLUTION_ISA(ConvolveRow)(const uint8_t *const rows[], uint8_t *dst, int begin, int end, int cn, int size, const float weights[], float scale, float bias)
+{
+    WithSize(size, [&](auto n)
+             { RowKernel<decltype(n)::value>(rows, dst, begin, end, cn, size, weights, scale, bias); });
+}
+
+void CONVOLUTION_ISA(ConvolveHorizontal)(const uint8_t *src, float *dst, int begin, int end, int cn, int size, const float weights[])
+{
+    WithSize(size, [&](auto n)
+             { HorizontalKernel<decltype(n)::value>(src, dst, begin, end, cn, size, weights); });
+}
+
+void CONVOLUTION_ISA(ConvolveVertical)(const float *const rows[], uint8_t *dst, int begin, int end, int size, const float weights[], float scale, float bias)
+{
+    WithSize(size, [&](auto n)
+             { VerticalKernel<decltype(n)::value>(rows, dst, begin, end, size, weights, scale, bias); });
+}
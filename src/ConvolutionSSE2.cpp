@@ -0,0 +1,7 @@
+// Compiled with the baseline x86-64 flags (see src/CMakeLists.txt)
+#if !defined(__SSE2__)
+#error "ConvolutionSSE2.cpp must be compiled with __SSE2__ enabled"
+#endif
+
+#define CONVOLUTION_ISA(name) name##SSE2
+#include "ConvolutionKernels.inl"
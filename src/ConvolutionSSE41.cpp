@@ -0,0 +1,7 @@
+// Compiled with -msse4.1 (see src/CMakeLists.txt)
+#if !defined(__SSE4_1__)
+#error "ConvolutionSSE41.cpp must be compiled with __SSE4_1__ enabled"
+#endif
+
+#define CONVOLUTION_ISA(name) name##SSE41
+#include "ConvolutionKernels.inl"
@@ -0,0 +1,149 @@
+#ifndef CpuDispatch_hpp
+#define CpuDispatch_hpp
+
+#include <cctype>
+#include <cpuid.h>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/**
+ * Instruction set tiers of the CPU kernels, from the oldest to the widest.
+ */
+enum class CpuIsa
+{
+    Scalar,
+    SSE2,
+    SSE41,
+    AVX2,
+    AVX512
+};
+
+// Environment variable used to force a lower tier (e.g. GL_COMPUTE_CPU_ISA=sse2) for A/B measurements
+static const char *CpuIsaEnvVar = "GL_COMPUTE_CPU_ISA";
+
+[[maybe_unused]]
+static std::string CpuIsaName(CpuIsa isa)
+{
+    switch (isa)
+    {
+    case CpuIsa::Scalar:
+        return "Scalar";
+    case CpuIsa::SSE2:
+        return "SSE2";
+    case CpuIsa::SSE41:
+        return "SSE4.1";
+    case CpuIsa::AVX2:
+        return "AVX2";
+    case CpuIsa::AVX512:
+        return "AVX-512";
+    default:
+        return std::to_string(static_cast<int>(isa));
+    }
+}
+
+/**
+ * @brief Parse a tier name (case insensitive: scalar, sse2, sse41, avx2, avx512).
+ *
+ * @param name The name to parse.
+ * @param isa The parsed tier.
+ * @return true if the name is known.
+ */
+[[maybe_unused]]
+static bool ParseCpuIsa(std::string name, CpuIsa &isa)
+{
+    std::string key;
+    for (char c : name)
+        if (c != '.' && c != '-' && c != '_')
+            key += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+    if (key == "scalar")
+        isa = CpuIsa::Scalar;
+    else if (key == "sse2")
+        isa = CpuIsa::SSE2;
+    else if (key == "sse41")
+        isa = CpuIsa::SSE41;
+    else if (key == "avx2")
+        isa = CpuIsa::AVX2;
+    else if (key == "avx512")
+        isa = CpuIsa::AVX512;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * @brief Detect the widest tier supported by both the CPU (cpuid) and the OS (xgetbv register state).
+ */
+[[maybe_unused]]
+static CpuIsa DetectCpuIsa()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return CpuIsa::Scalar;
+
+    const bool sse2 = edx & bit_SSE2;
+    const bool sse41 = ecx & bit_SSE4_1;
+    const bool osxsave = ecx & bit_OSXSAVE;
+
+    // XCR0: bits 1-2 = XMM/YMM state, bits 5-7 = opmask/ZMM state
+    uint64_t xcr0 = 0;
+    if (osxsave)
+    {
+        uint32_t lo, hi;
+        __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+    const bool ymm = (xcr0 & 0x06) == 0x06;
+    const bool zmm = (xcr0 & 0xe6) == 0xe6;
+
+    bool avx2 = false, avx512 = false;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    {
+        avx2 = (ebx & bit_AVX2) && ymm;
+        avx512 = (ebx & bit_AVX512F) && zmm;
+    }
+
+    if (avx512)
+        return CpuIsa::AVX512;
+    if (avx2)
+        return CpuIsa::AVX2;
+    if (sse41)
+        return CpuIsa::SSE41;
+    if (sse2)
+        return CpuIsa::SSE2;
+    return CpuIsa::Scalar;
+}
+
+/**
+ * @brief Pick the tier for this run: the detected one, unless GL_COMPUTE_CPU_ISA asks for a lower one.
+ *
+ * @remark Requests above the detected tier are ignored (they would crash on an illegal instruction).
+ */
+[[maybe_unused]]
+static CpuIsa SelectCpuIsa()
+{
+    const CpuIsa detected = DetectCpuIsa();
+
+    const char *forced = std::getenv(CpuIsaEnvVar);
+    if (forced == nullptr || *forced == '\0')
+        return detected;
+
+    CpuIsa requested;
+    if (!ParseCpuIsa(forced, requested))
+    {
+        std::cout << "[CpuDispatch] Unknown " << CpuIsaEnvVar << "=" << forced << ", using " << CpuIsaName(detected) << std::endl;
+        return detected;
+    }
+
+    if (requested > detected)
+    {
+        std::cout << "[CpuDispatch] " << CpuIsaName(requested) << " is not supported, using " << CpuIsaName(detected) << std::endl;
+        return detected;
+    }
+
+    return requested;
+}
+
+#endif // CpuDispatch_hpp
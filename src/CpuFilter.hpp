@@ -0,0 +1,182 @@
+#ifndef CpuFilter_hpp
+#define CpuFilter_hpp
+
+#include <algorithm>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "Convolution.hpp"
+#include "CpuTiling.hpp"
+#include "Kernel.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * @brief The tiles covering the interior of an image (the border pixels of the kernel radius are skipped).
+ */
+struct TileGrid
+{
+    int x0, y0, x1, y1;
+    int countX, countY;
+    TileShape shape;
+
+    TileGrid(const cv::Mat &image, int radius, const TileShape &tile) : x0(radius), y0(radius), x1(image.cols - radius), y1(image.rows - radius), shape(tile)
+    {
+        countX = x1 > x0 ? (x1 - x0 + shape.width - 1) / shape.width : 0;
+        countY = y1 > y0 ? (y1 - y0 + shape.height - 1) / shape.height : 0;
+    }
+
+    /**
+     * @brief The pixel bounds [left, right) x [top, bottom) of tile (tx, ty).
+     */
+    void Bounds(int tx, int ty, int &left, int &top, int &right, int &bottom) const
+    {
+        left = x0 + tx * shape.width;
+        top = y0 + ty * shape.height;
+        right = std::min(left + shape.width, x1);
+        bottom = std::min(top + shape.height, y1);
+    }
+};
+
+/**
+ * @brief Apply a kernel with all its taps.
+ *
+ * @param input The image to filter.
+ * @param output The filtered image (allocated, borders left untouched).
+ * @param kernel The kernel.
+ * @param tile The shape of the blocks handed to the threads.
+ * @param threads The maximum number of threads.
+ */
+inline void FilterCPUDirect(const cv::Mat &input, cv::Mat &output, const Kernel &kernel, const TileShape &tile, int threads)
+{
+    const int cn = input.channels();
+    const int radius = kernel.Radius();
+    const TileGrid grid(input, radius, tile);
+
+    // The row kernel walks the interleaved bytes [left * cn, right * cn) of each row of the tile
+    ThreadPool::Shared().ParallelFor2D(grid.countX, grid.countY, threads, [&](int tx, int ty)
+                                       {
+        thread_local std::vector<const uint8_t *> src;
+        src.resize(kernel.size);
+
+        int left, top, right, bottom;
+        grid.Bounds(tx, ty, left, top, right, bottom);
+        for (int y = top; y < bottom; ++y)
+        {
+            for (int k = 0; k < kernel.size; ++k)
+                src[k] = input.ptr<uint8_t>(y - radius + k);
+            ConvolveRow(src.data(), output.ptr<uint8_t>(y), left * cn, right * cn, cn, kernel);
+        } });
+}
+
+/**
+ * @brief Apply a separable kernel in two passes (size + size taps per pixel instead of size * size).
+ *
+ * Each thread keeps the horizontal sums of the last size rows of its tile in a ring of float rows: moving to the
+ * next output row only computes the horizontal pass of one new input row, then the vertical pass combines the ring.
+ * The first size - 1 rows of a tile are recomputed, taller tiles amortize them.
+ *
+ * @param input The image to filter.
+ * @param output The filtered image (allocated, borders left untouched).
+ * @param kernel The kernel (radius, scale and bias).
+ * @param column The column factor of the kernel.
+ * @param row The row factor of the kernel.
+ * @param tile The shape of the blocks handed to the threads.
+ * @param threads The maximum number of threads.
+ */
+inline void FilterCPUSeparable(const cv::Mat &input, cv::Mat &output, const Kernel &kernel, const std::vector<float> &column, const std::vector<float> &row,
+                               const TileShape &tile, int threads)
+{
+    const int cn = input.channels();
+    const int size = kernel.size;
+    const int radius = kernel.Radius();
+    const TileGrid grid(input, radius, tile);
+    const int stride = tile.width * cn;
+
+    ThreadPool::Shared().ParallelFor2D(grid.countX, grid.countY, threads, [&](int tx, int ty)
+                                       {
+        // Horizontal sums of input row j (tile columns only) live in slot j % size, kept by each thread between tiles
+        thread_local std::vector<float> ring;
+        thread_local std::vector<const float *> window;
+        ring.resize(static_cast<size_t>(size) * stride);
+        window.resize(size);
+
+        int left, top, right, bottom;
+        grid.Bounds(tx, ty, left, top, right, bottom);
+        const int bytes = (right - left) * cn;
+
+        int computed = top - radius - 1; // last input row of the ring
+        for (int y = top; y < bottom; ++y)
+        {
+            // The tile starts at least radius pixels from the borders, the taps stay inside the row
+            for (int j = std::max(computed + 1, y - radius); j <= y + radius; ++j)
+                ConvolveHorizontal(input.ptr<uint8_t>(j) + left * cn, ring.data() + static_cast<size_t>(j % size) * stride, 0, bytes, cn, row);
+            computed = y + radius;
+
+            for (int k = 0; k < size; ++k)
+                window[k] = ring.data() + static_cast<size_t>((y - radius + k) % size) * stride;
+            ConvolveVertical(window.data(), output.ptr<uint8_t>(y) + left * cn, 0, bytes, column, kernel);
+        } });
+}
+
+/**
+ * @brief Zero the pixels closer than radius to a side of the image.
+ */
+inline void ClearBorder(cv::Mat &image, int radius)
+{
+    if (2 * radius >= image.rows || 2 * radius >= image.cols)
+    {
+        image.setTo(0);
+        return;
+    }
+    if (radius == 0)
+        return;
+
+    image.rowRange(0, radius).setTo(0);
+    image.rowRange(image.rows - radius, image.rows).setTo(0);
+    image(cv::Rect(0, radius, radius, image.rows - 2 * radius)).setTo(0);
+    image(cv::Rect(image.cols - radius, radius, radius, image.rows - 2 * radius)).setTo(0);
+}
+
+/**
+ * @brief Apply the filter to an image using the CPU.
+ *
+ * @param input The image to filter.
+ * @param output The filtered image.
+ * @param kernel The kernel to apply.
+ * @param useParallel Should the function use parallel processing.
+ * @param tile The shape of the blocks handed to the threads (see TileConfig), the default shape when invalid.
+ *
+ * The image is split into cache-sized 2D blocks scheduled over the threads of the shared work-stealing pool
+ * (small images get shorter blocks so every thread has work). The parallelism is limited per call, concurrent
+ * calls from several threads are safe.
+ * Separable kernels (rank 1) run as a horizontal then a vertical pass.
+ *
+ * @remark To avoid handling the clamping, the border pixels (kernel radius) are ignored.
+ */
+inline void FilterCPU(const cv::Mat &input, cv::Mat &output, const Kernel &kernel, bool useParallel, TileShape tile = TileShape())
+{
+    CV_Assert(input.channels() == 3); // Ensure RGB
+    CV_Assert(input.depth() == CV_8U);
+
+    // Create the output (same size and format as the input), an output of the right size is filled in place
+    // (shared memory frames, ...): only the border the kernel does not reach is cleared
+    if (output.data == input.data)
+        output.release();
+    output.create(input.rows, input.cols, CV_8UC3);
+    ClearBorder(output, kernel.Radius());
+
+    // No parallel => the calling thread only
+    const int threads = useParallel ? ThreadPool::Shared().Threads() : 1;
+
+    if (!tile.Valid())
+        tile = TileShape::Default(kernel);
+    tile = tile.Balanced(input.cols, input.rows, threads, 2 * kernel.size);
+
+    std::vector<float> column, row;
+    if (kernel.IsSeparable(column, row))
+        FilterCPUSeparable(input, output, kernel, column, row, tile, threads);
+    else
+        FilterCPUDirect(input, output, kernel, tile, threads);
+}
+
+#endif // CpuFilter_hpp
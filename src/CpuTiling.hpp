@@ -0,0 +1,202 @@
+#ifndef CpuTiling_hpp
+#define CpuTiling_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Benchmark.hpp"
+#include "ConfigFile.hpp"
+#include "Convolution.hpp"
+#include "Kernel.hpp"
+
+/**
+ * 2D block of output pixels processed by one task of the CPU filter.
+ */
+struct TileShape
+{
+    int width = 0;
+    int height = 0;
+
+    bool Valid() const { return width > 0 && height > 0; }
+
+    /**
+     * @brief The shape used until the machine is tuned: 1024 pixels wide keeps the rows of the kernel window
+     * in L1 / L2 and the vector loops long. Separable tiles are taller, each tile recomputes size - 1 rows of
+     * the horizontal pass.
+     */
+    static TileShape Default(const Kernel &kernel)
+    {
+        const bool separable = kernel.IsSeparable();
+
+        TileShape shape;
+        shape.width = 1024;
+        shape.height = separable ? std::max(64, 8 * kernel.size) : 64;
+        return shape;
+    }
+
+    /**
+     * @brief Lower the height until the image splits into at least 4 tiles per thread (dynamic scheduling
+     * then balances the load), tiles are kept at least minHeight rows tall.
+     */
+    TileShape Balanced(int cols, int rows, int threads, int minHeight) const
+    {
+        TileShape shape = *this;
+        const int countX = (cols + width - 1) / width;
+        while (shape.height / 2 >= minHeight && countX * ((rows + shape.height - 1) / shape.height) < 4 * threads)
+            shape.height /= 2;
+        return shape;
+    }
+};
+
+/**
+ * Tile shapes tuned per machine, stored in a small text file.
+ *
+ * One line per configuration: "key width height", the key holds the CPU kernel tier, the path
+ * (direct or separable), the kernel size and the number of threads, e.g. "AVX2:separable:5:8 512 64".
+ * '#' starts a comment.
+ *
+ * Location: $GL_COMPUTE_TILE_CONFIG, else $XDG_CONFIG_HOME/gl-compute/cpu-tiles.conf, else ~/.config/gl-compute/cpu-tiles.conf.
+ */
+class TileConfig
+{
+public:
+    TileConfig() : _file("GL_COMPUTE_TILE_CONFIG", "cpu-tiles.conf", "TileConfig") { Load(); }
+
+    explicit TileConfig(const std::filesystem::path &path) : _file(path, "TileConfig") { Load(); }
+
+    const std::filesystem::path &Path() const { return _file.Path(); }
+
+    /**
+     * @brief The key of a kernel run with a number of threads on this machine.
+     */
+    static std::string KeyOf(const Kernel &kernel, int threads)
+    {
+        const bool separable = kernel.IsSeparable();
+        return CpuIsaName(ActiveCpuIsa()) + ":" + (separable ? "separable" : "direct") + ":" + std::to_string(kernel.size) + ":" + std::to_string(threads);
+    }
+
+    /**
+     * @brief The tuned shape of a kernel, the default shape when not tuned.
+     */
+    TileShape Get(const Kernel &kernel, int threads) const
+    {
+        auto found = _shapes.find(KeyOf(kernel, threads));
+        return found != _shapes.end() ? found->second : TileShape::Default(kernel);
+    }
+
+    void Set(const Kernel &kernel, int threads, const TileShape &shape)
+    {
+        _shapes[KeyOf(kernel, threads)] = shape;
+    }
+
+    /**
+     * @brief Write every shape (the directory is created when needed).
+     *
+     * @return false if the file cannot be written.
+     */
+    bool Save() const
+    {
+        return _file.Write("gl-compute CPU tile shapes: key width height", [&](std::ostream &file)
+        {
+            for (const auto &[key, shape] : _shapes)
+                file << key << " " << shape.width << " " << shape.height << "\n";
+        });
+    }
+
+private:
+    /**
+     * @brief Read the shapes, a missing file is an empty configuration and invalid lines are skipped.
+     */
+    void Load()
+    {
+        _file.Read([&](std::istringstream &fields)
+        {
+            std::string key;
+            TileShape shape;
+            if (fields >> key >> shape.width >> shape.height && shape.Valid())
+                _shapes[key] = shape;
+        });
+    }
+
+private:
+    ConfigFile _file;
+    std::map<std::string, TileShape> _shapes;
+};
+
+/**
+ * Sweep of the tile shapes of the CPU filter.
+ */
+class TileTuner
+{
+public:
+    typedef std::function<void(const TileShape &shape)> RunFn;
+
+    /**
+     * @brief The shapes to try for an image: widths from 64 pixels to the full row (powers of two, then the
+     * row), heights from 4 to 512 rows (powers of two below the image height, taller bands only lengthen the
+     * sweep) then the full image.
+     */
+    static std::vector<TileShape> Candidates(int cols, int rows)
+    {
+        std::vector<int> widths, heights;
+        for (int w = 64; w < cols; w *= 2)
+            widths.push_back(w);
+        widths.push_back(cols);
+        for (int h = 4; h < rows && h <= 512; h *= 2)
+            heights.push_back(h);
+        heights.push_back(rows);
+
+        std::vector<TileShape> shapes;
+        for (int w : widths)
+            for (int h : heights)
+                shapes.push_back({w, h});
+        return shapes;
+    }
+
+    /**
+     * @brief Time every shape and return the one with the smallest median.
+     *
+     * @param run Filters the tuning image with a shape.
+     * @param shapes The shapes to try.
+     * @param iterations The timed runs per shape (after one warmup run).
+     */
+    static TileShape Tune(const RunFn &run, const std::vector<TileShape> &shapes, int iterations)
+    {
+        typedef std::chrono::steady_clock clock;
+
+        TileShape best;
+        double bestMedian = 0.0;
+        for (const TileShape &shape : shapes)
+        {
+            run(shape);
+
+            std::vector<double> samples;
+            for (int i = 0; i < iterations; ++i)
+            {
+                auto t0 = clock::now();
+                run(shape);
+                auto t1 = clock::now();
+                samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+            }
+
+            const double median = BenchmarkStats::From(samples).median;
+            if (!best.Valid() || median < bestMedian)
+            {
+                best = shape;
+                bestMedian = median;
+            }
+        }
+
+        std::cout << "[TileTuner] Best : " << best.width << " x " << best.height << " (" << bestMedian * 1e-6 << " ms)" << std::endl;
+        return best;
+    }
+};
+
+#endif // CpuTiling_hpp
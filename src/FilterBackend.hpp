@@ -0,0 +1,200 @@
+#ifndef FilterBackend_hpp
+#define FilterBackend_hpp
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "CpuFilter.hpp"
+#include "CpuTiling.hpp"
+#include "GpuFilterContext.hpp"
+#include "Kernel.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * A way of applying a kernel to an 8-bit BGR image, selected by name from a FilterBackendRegistry.
+ */
+class IFilterBackend
+{
+public:
+    virtual ~IFilterBackend() = default;
+
+    /**
+     * @brief The name of the backend (benchmark tables, --method).
+     */
+    virtual std::string Name() const = 0;
+
+    /**
+     * @brief Whether the backend runs other registered backends (Hybrid, Auto): it is then never measured
+     * nor chosen by the Auto backend.
+     */
+    virtual bool Composite() const { return false; }
+
+    /**
+     * @brief Apply a kernel.
+     *
+     * @param input The image to filter (8-bit BGR).
+     * @param output The filtered image.
+     * @param kernel The kernel to apply.
+     */
+    virtual void Filter(const cv::Mat &input, cv::Mat &output, const Kernel &kernel) = 0;
+
+    /**
+     * @brief Apply a kernel to a batch of images, one after the other unless the backend does better.
+     *
+     * @param inputs The images to filter (8-bit BGR).
+     * @param outputs The filtered images, resized to the number of inputs.
+     * @param kernel The kernel to apply.
+     */
+    virtual void FilterBatch(const std::vector<cv::Mat> &inputs, std::vector<cv::Mat> &outputs, const Kernel &kernel)
+    {
+        outputs.resize(inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i)
+            Filter(inputs[i], outputs[i], kernel);
+    }
+};
+
+/**
+ * The CPU filter, on the calling thread only (CPU) or on the shared thread pool (CPU_MP),
+ * with the tile shapes tuned for the machine.
+ *
+ * @remark The border pixels of the kernel radius are left black (see FilterCPU()).
+ */
+class CpuBackend : public IFilterBackend
+{
+public:
+    CpuBackend(const TileConfig &tiles, bool parallel) : _tiles(tiles), _parallel(parallel) {}
+
+    std::string Name() const override { return _parallel ? "CPU_MP" : "CPU"; }
+
+    void Filter(const cv::Mat &input, cv::Mat &output, const Kernel &kernel) override
+    {
+        const int threads = _parallel ? ThreadPool::Shared().Threads() : 1;
+        FilterCPU(input, output, kernel, _parallel, _tiles.Get(kernel, threads));
+    }
+
+private:
+    const TileConfig &_tiles;
+    bool _parallel;
+};
+
+/**
+ * One of the paths of a GpuFilterContext: fragment shader, compute shader on textures or
+ * compute shader on packed storage buffers. The context switches to the kernel of each call
+ * (its programs are kept per kernel).
+ */
+class GpuBackend : public IFilterBackend
+{
+public:
+    enum class Path
+    {
+        Shader,
+        Compute,
+        ComputePacked
+    };
+
+    GpuBackend(GpuFilterContext &gpu, Path path) : _gpu(gpu), _path(path) {}
+
+    std::string Name() const override
+    {
+        switch (_path)
+        {
+        case Path::Shader:
+            return "Shader";
+        case Path::Compute:
+            return "Compute_Shader";
+        case Path::ComputePacked:
+            return "Compute_Packed";
+        }
+        return "";
+    }
+
+    void Filter(const cv::Mat &input, cv::Mat &output, const Kernel &kernel) override
+    {
+        if (_gpu.GetKernel().Key() != kernel.Key())
+            _gpu.SetKernel(kernel);
+
+        switch (_path)
+        {
+        case Path::Shader:
+            _gpu.FilterShader(input, output);
+            break;
+        case Path::Compute:
+            _gpu.FilterComputeShader(input, output);
+            break;
+        case Path::ComputePacked:
+            _gpu.FilterComputePacked(input, output);
+            break;
+        }
+    }
+
+private:
+    GpuFilterContext &_gpu;
+    Path _path;
+};
+
+/**
+ * The backends of the program by name, in registration order.
+ */
+class FilterBackendRegistry
+{
+public:
+    /**
+     * @brief Add a backend, replacing the one of the same name.
+     *
+     * @return The registered backend.
+     */
+    template <typename Backend>
+    Backend &Register(std::unique_ptr<Backend> backend)
+    {
+        Backend &registered = *backend;
+        for (std::unique_ptr<IFilterBackend> &existing : _backends)
+            if (existing->Name() == registered.Name())
+            {
+                existing = std::move(backend);
+                return registered;
+            }
+        _backends.push_back(std::move(backend));
+        return registered;
+    }
+
+    /**
+     * @brief The backend of a name.
+     *
+     * @throw std::runtime_error If no backend has this name.
+     */
+    IFilterBackend &Get(const std::string &name) const
+    {
+        for (const std::unique_ptr<IFilterBackend> &backend : _backends)
+            if (backend->Name() == name)
+                return *backend;
+
+        std::string names;
+        for (const std::string &known : Names())
+            names += (names.empty() ? "" : ", ") + known;
+        throw std::runtime_error("Unknown backend " + name + " (" + names + ")");
+    }
+
+    std::vector<IFilterBackend *> Backends() const
+    {
+        std::vector<IFilterBackend *> backends;
+        for (const std::unique_ptr<IFilterBackend> &backend : _backends)
+            backends.push_back(backend.get());
+        return backends;
+    }
+
+    std::vector<std::string> Names() const
+    {
+        std::vector<std::string> names;
+        for (const std::unique_ptr<IFilterBackend> &backend : _backends)
+            names.push_back(backend->Name());
+        return names;
+    }
+
+private:
+    std::vector<std::unique_ptr<IFilterBackend>> _backends;
+};
+
+#endif // FilterBackend_hpp
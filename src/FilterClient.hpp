@@ -0,0 +1,127 @@
+#ifndef FilterClient_hpp
+#define FilterClient_hpp
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+
+#include "FilterProtocol.hpp"
+#include "Kernel.hpp"
+
+/**
+ * Connection to a FilterServer: sends filter jobs and waits for their result.
+ *
+ * The images up to the inline limit travel through the socket, larger ones through a shared memory segment
+ * kept between the requests (the server filters it in place).
+ */
+class FilterClient
+{
+public:
+    /**
+     * @param path The socket of the server.
+     * @param inlineLimit The largest image (bytes) sent through the socket.
+     * @throw std::runtime_error If the server cannot be reached.
+     */
+    FilterClient(const std::string &path, size_t inlineLimit) : _socket(-1), _inlineLimit(inlineLimit), _filterNanoseconds(0)
+    {
+        const sockaddr_un address = FilterProtocol::Address(path);
+        _socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (_socket < 0 || connect(_socket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            if (_socket >= 0)
+                close(_socket);
+            throw std::runtime_error("Cannot connect to " + path + " (is the server running?)");
+        }
+    }
+
+    ~FilterClient()
+    {
+        close(_socket);
+    }
+
+    FilterClient(const FilterClient &) = delete;
+    FilterClient &operator=(const FilterClient &) = delete;
+
+    /**
+     * @brief Filter an image on the server.
+     *
+     * @param input The image to filter (8-bit BGR).
+     * @param output The filtered image.
+     * @param kernel The kernel to apply.
+     * @param method The backend of the server, empty for its default one.
+     * @throw std::runtime_error If the connection fails or the server reports an error.
+     */
+    void Filter(const cv::Mat &input, cv::Mat &output, const Kernel &kernel, const std::string &method = "")
+    {
+        using namespace FilterProtocol;
+
+        if (input.type() != CV_8UC3)
+            throw std::runtime_error("The server filters 8-bit BGR images only");
+
+        RequestHeader request;
+        request.width = static_cast<uint32_t>(input.cols);
+        request.height = static_cast<uint32_t>(input.rows);
+        request.kernelSize = static_cast<uint32_t>(kernel.size);
+        request.divisor = kernel.divisor;
+        request.bias = kernel.bias;
+        request.methodLength = static_cast<uint32_t>(method.size());
+
+        const size_t bytes = ImageBytes(request.width, request.height);
+        const size_t rowBytes = static_cast<size_t>(input.cols) * 3;
+        int fd = -1;
+        if (bytes > _inlineLimit)
+        {
+            request.transport = Transport::SharedMemory;
+            _shared.Allocate(2 * bytes);
+            for (int y = 0; y < input.rows; ++y)
+                std::memcpy(_shared.Data() + y * rowBytes, input.ptr(y), rowBytes);
+            fd = _shared.Fd();
+        }
+
+        bool sent = Send(_socket, &request, sizeof(request), fd) && Send(_socket, method.data(), method.size()) &&
+                    Send(_socket, kernel.weights.data(), kernel.weights.size() * sizeof(float));
+        if (request.transport == Transport::Inline)
+        {
+            if (input.isContinuous())
+                sent = sent && Send(_socket, input.data, bytes);
+            else
+                for (int y = 0; y < input.rows && sent; ++y)
+                    sent = Send(_socket, input.ptr(y), rowBytes);
+        }
+
+        ResponseHeader response;
+        if (!sent || !Receive(_socket, &response, sizeof(response)) || response.magic != Magic)
+            throw std::runtime_error("Connection to the server lost");
+
+        std::string error(response.messageLength, '\0');
+        if (!Receive(_socket, error.data(), error.size()))
+            throw std::runtime_error("Connection to the server lost");
+        if (response.status != 0)
+            throw std::runtime_error("Server error : " + error);
+
+        output.create(input.rows, input.cols, CV_8UC3);
+        if (request.transport == Transport::SharedMemory)
+            cv::Mat(input.rows, input.cols, CV_8UC3, _shared.Data() + bytes).copyTo(output);
+        else if (!Receive(_socket, output.data, bytes))
+            throw std::runtime_error("Connection to the server lost");
+
+        _filterNanoseconds = response.filterNanoseconds;
+    }
+
+    /**
+     * @brief The time the server spent filtering the last image (transfers excluded), in ns.
+     */
+    uint64_t LastFilterNanoseconds() const { return _filterNanoseconds; }
+
+private:
+    int _socket;
+    size_t _inlineLimit;
+    FilterProtocol::SharedMemory _shared;
+    uint64_t _filterNanoseconds;
+};
+
+#endif // FilterClient_hpp
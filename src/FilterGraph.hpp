@@ -0,0 +1,526 @@
+#ifndef FilterGraph_hpp
+#define FilterGraph_hpp
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "Convolution.hpp"
+#include "Kernel.hpp"
+#include "ThreadPool.hpp"
+
+/**
+ * One operation of a FilterGraph, reading the images of earlier nodes.
+ */
+struct FilterNode
+{
+    enum class Type
+    {
+        Input,       // The image given to the executor
+        Convolution, // kernel, borders clamped
+        Threshold,   // 255 where the value is >= level, else 0 (per channel)
+        Blend        // weightA * a + weightB * b + bias, saturated
+    };
+
+    Type type = Type::Input;
+    std::vector<int> inputs;
+    Kernel kernel = Kernel("identity", 1, {1.0f});
+    int level = 128;
+    float weightA = 1.0f;
+    float weightB = 1.0f;
+    float bias = 0.0f;
+
+    /**
+     * @brief The rows / columns of the inputs read around a pixel.
+     */
+    int Radius() const { return type == Type::Convolution ? kernel.Radius() : 0; }
+
+    std::string Describe() const
+    {
+        std::ostringstream text;
+        switch (type)
+        {
+        case Type::Input:
+            text << "input";
+            break;
+        case Type::Convolution:
+            text << kernel.name << "(" << inputs[0] << ")";
+            break;
+        case Type::Threshold:
+            text << "threshold " << level << "(" << inputs[0] << ")";
+            break;
+        case Type::Blend:
+            text << "blend " << weightA << " * " << inputs[0] << " + " << weightB << " * " << inputs[1];
+            if (bias != 0.0f)
+                text << " + " << bias;
+            break;
+        }
+        return text.str();
+    }
+};
+
+/**
+ * Chain of filter operations on one 8-bit BGR image: the nodes are convolutions or per-pixel passes
+ * (threshold, blend) and the edges the intermediate images. Node 0 is the input, a node only reads
+ * earlier nodes, so the order of the nodes is an order of execution. The sinks are the nodes marked as
+ * outputs, the executors only produce these (GpuFilterGraph keeps the other ones in textures,
+ * CpuFilterGraph in a few rows each).
+ *
+ * Unlike FilterCPU(), the convolutions clamp the borders (like the fragment shaders), so the output of a
+ * node is defined everywhere and can feed the next one.
+ */
+class FilterGraph
+{
+public:
+    FilterGraph()
+    {
+        _nodes.emplace_back();
+    }
+
+    /**
+     * @brief The node of the input image.
+     */
+    int Input() const { return 0; }
+
+    int Convolve(int input, const Kernel &kernel)
+    {
+        FilterNode node;
+        node.type = FilterNode::Type::Convolution;
+        node.kernel = kernel;
+        return Add(node, {input});
+    }
+
+    /**
+     * @throw std::runtime_error If level is not in [0, 256].
+     */
+    int Threshold(int input, int level)
+    {
+        if (level < 0 || level > 256)
+            throw std::runtime_error("Invalid threshold " + std::to_string(level) + " (0 to 256)");
+
+        FilterNode node;
+        node.type = FilterNode::Type::Threshold;
+        node.level = level;
+        return Add(node, {input});
+    }
+
+    /**
+     * @param bias Added to the weighted sum, in [0, 255] units.
+     */
+    int Blend(int a, int b, float weightA, float weightB, float bias = 0.0f)
+    {
+        FilterNode node;
+        node.type = FilterNode::Type::Blend;
+        node.weightA = weightA;
+        node.weightB = weightB;
+        node.bias = bias;
+        return Add(node, {a, b});
+    }
+
+    /**
+     * @brief Mark a node as a sink: the executors return its image, in the order of the calls.
+     *
+     * @throw std::runtime_error If the node does not exist.
+     */
+    void Output(int node)
+    {
+        Check(node);
+        _outputs.push_back(node);
+    }
+
+    const std::vector<FilterNode> &Nodes() const { return _nodes; }
+    const std::vector<int> &Outputs() const { return _outputs; }
+
+    /**
+     * @brief Whether the image of each node is needed by a sink (the other nodes are skipped).
+     */
+    std::vector<bool> Live() const
+    {
+        std::vector<bool> live(_nodes.size(), false);
+        for (int output : _outputs)
+            live[output] = true;
+        for (size_t n = _nodes.size(); n-- > 1;)
+            if (live[n])
+                for (int input : _nodes[n].inputs)
+                    live[input] = true;
+        return live;
+    }
+
+    /**
+     * @brief The last node reading each node (-1 when none), the executors release its image after it.
+     */
+    std::vector<int> LastUse() const
+    {
+        const std::vector<bool> live = Live();
+        std::vector<int> last(_nodes.size(), -1);
+        for (size_t n = 1; n < _nodes.size(); ++n)
+            if (live[n])
+                for (int input : _nodes[n].inputs)
+                    last[input] = static_cast<int>(n);
+        return last;
+    }
+
+    std::string Describe() const
+    {
+        std::ostringstream text;
+        for (size_t n = 1; n < _nodes.size(); ++n)
+            text << (n > 1 ? ", " : "") << n << ": " << _nodes[n].Describe();
+        text << " -> outputs";
+        for (int output : _outputs)
+            text << " " << output;
+        return text.str();
+    }
+
+    /**
+     * @brief Build a graph from a comma separated list of steps, each one applied to the previous step
+     * (the input for the first one). The last step is an output.
+     *
+     *   NAME                   convolution by a kernel (edge, sharp, gaussian5 or a kernel file)
+     *   threshold:LEVEL        255 where the value is >= LEVEL, else 0
+     *   blend:N:WA:WB[:BIAS]   WA * previous + WB * step N (0 is the input, 1 the first step, ..., out not counted) + BIAS
+     *   out                    also output the previous step
+     *
+     * e.g. "gaussian5,edge,threshold:32" or "gaussian5,blend:0:-1:2" (unsharp mask).
+     *
+     * @throw std::runtime_error If a step is invalid.
+     */
+    static FilterGraph Parse(const std::string &spec)
+    {
+        FilterGraph graph;
+        std::vector<int> steps = {graph.Input()};
+        bool outputLast = false;
+
+        std::stringstream list(spec);
+        std::string step;
+        while (std::getline(list, step, ','))
+        {
+            std::vector<std::string> fields;
+            std::stringstream parts(step);
+            std::string field;
+            while (std::getline(parts, field, ':'))
+                fields.push_back(field);
+            if (fields.empty() || fields[0].empty())
+                throw std::runtime_error("Empty step in the graph " + spec);
+
+            const int previous = steps.back();
+            if (fields[0] == "out" && fields.size() == 1)
+            {
+                if (previous == graph.Input())
+                    throw std::runtime_error("The input is not a step of the graph " + spec);
+                graph.Output(previous);
+                outputLast = false;
+                continue;
+            }
+
+            if (fields[0] == "threshold" && fields.size() == 2)
+                steps.push_back(graph.Threshold(previous, static_cast<int>(Number(fields[1], step))));
+            else if (fields[0] == "blend" && (fields.size() == 4 || fields.size() == 5))
+            {
+                const float other = Number(fields[1], step);
+                if (other != static_cast<int>(other) || other < 0 || other >= static_cast<float>(steps.size()))
+                    throw std::runtime_error("Invalid step " + fields[1] + " in " + step);
+                steps.push_back(graph.Blend(previous, steps[static_cast<size_t>(other)], Number(fields[2], step), Number(fields[3], step),
+                                            fields.size() == 5 ? Number(fields[4], step) : 0.0f));
+            }
+            else
+                steps.push_back(graph.Convolve(previous, Kernel::FromName(step)));
+            outputLast = true;
+        }
+
+        if (steps.size() == 1)
+            throw std::runtime_error("No step in the graph " + spec);
+        if (outputLast)
+            graph.Output(steps.back());
+        return graph;
+    }
+
+private:
+    int Add(FilterNode &node, const std::vector<int> &inputs)
+    {
+        for (int input : inputs)
+            Check(input);
+        node.inputs = inputs;
+        _nodes.push_back(node);
+        return static_cast<int>(_nodes.size()) - 1;
+    }
+
+    void Check(int node) const
+    {
+        if (node < 0 || node >= static_cast<int>(_nodes.size()))
+            throw std::runtime_error("No node " + std::to_string(node) + " in the filter graph");
+    }
+
+    static float Number(const std::string &text, const std::string &step)
+    {
+        char *end = nullptr;
+        const float value = std::strtof(text.c_str(), &end);
+        if (text.empty() || *end != '\0')
+            throw std::runtime_error("Invalid number " + text + " in " + step);
+        return value;
+    }
+
+    std::vector<FilterNode> _nodes;
+    std::vector<int> _outputs;
+};
+
+/**
+ * Runs a FilterGraph on the CPU row by row: each node keeps only the rows its readers still need in a ring
+ * of line buffers, so the intermediate images are never allocated and stay in cache. A node runs the
+ * radius of its readers behind its inputs (its lag), at each step every node computes one row.
+ *
+ * The rows hold the pixels with the largest radius of the graph replicated on each side, so the row
+ * kernels (ConvolveRow, or ConvolveHorizontal and ConvolveVertical for separable kernels) run on the whole
+ * width with clamped borders. The image is split into bands of rows for the threads of the shared pool,
+ * each band computing the halo its convolutions need again. The line buffers of the bands are kept
+ * between the calls.
+ */
+class CpuFilterGraph
+{
+public:
+    /**
+     * @brief Run the graph.
+     *
+     * @param graph The graph.
+     * @param input The image of the input node (8-bit BGR).
+     * @param outputs The images of the outputs of the graph, in order.
+     * @param useParallel Should the bands run on the threads of the pool.
+     * @throw std::runtime_error If the graph has no output.
+     */
+    void Run(const FilterGraph &graph, const cv::Mat &input, std::vector<cv::Mat> &outputs, bool useParallel = true)
+    {
+        CV_Assert(input.type() == CV_8UC3);
+        if (graph.Outputs().empty())
+            throw std::runtime_error("The filter graph has no output");
+
+        Plan(graph, input);
+        outputs.resize(graph.Outputs().size());
+        for (cv::Mat &output : outputs)
+        {
+            if (output.data == input.data)
+                output.release();
+            output.create(input.rows, input.cols, CV_8UC3);
+        }
+
+        // Bands tall enough to amortize their halo
+        const int threads = useParallel ? ThreadPool::Shared().Threads() : 1;
+        const int bandRows = std::max(64, 8 * _halo);
+        const int bands = std::max(1, std::min(2 * threads, input.rows / bandRows));
+        if (static_cast<int>(_bands.size()) < bands)
+            _bands.resize(bands);
+
+        ThreadPool::Shared().ParallelFor(bands, threads, [&](int band)
+                                         { RunBand(graph, input, outputs, _bands[band], input.rows * band / bands, input.rows * (band + 1) / bands); });
+    }
+
+private:
+    // The rows of a node kept by a band
+    struct NodeLines
+    {
+        std::vector<uint8_t> rows;
+        // Horizontal sums of a separable kernel by input row (slot j % size), next input row to sum
+        std::vector<float> sums;
+        int nextSum = INT_MIN;
+    };
+
+    struct Band
+    {
+        std::vector<NodeLines> nodes;
+        std::vector<const uint8_t *> window;
+        std::vector<const float *> sumWindow;
+    };
+
+    // Schedule of a node, computed once per run
+    struct NodePlan
+    {
+        bool live = false;
+        int lag = 0;    // rows behind the input
+        int halo = 0;   // rows computed beyond a band for the readers
+        int slots = 1;  // rows kept
+        std::vector<float> column, row; // factors of a separable kernel (empty otherwise)
+    };
+
+    void Plan(const FilterGraph &graph, const cv::Mat &input)
+    {
+        const std::vector<FilterNode> &nodes = graph.Nodes();
+        const std::vector<bool> live = graph.Live();
+        _plans.assign(nodes.size(), NodePlan());
+        _cn = input.channels();
+        _cols = input.cols;
+        _pad = 0;
+        _halo = 0;
+
+        for (size_t n = 0; n < nodes.size(); ++n)
+        {
+            NodePlan &plan = _plans[n];
+            plan.live = live[n];
+            for (int i : nodes[n].inputs)
+                plan.lag = std::max(plan.lag, _plans[i].lag + nodes[n].Radius());
+            if (plan.live)
+                _pad = std::max(_pad, nodes[n].Radius());
+
+            const Kernel &kernel = nodes[n].kernel;
+            if (nodes[n].type == FilterNode::Type::Convolution && !kernel.IsSeparable(plan.column, plan.row))
+                plan.column.clear();
+        }
+
+        // A reader at row y needs the rows up to y + radius of its inputs, kept from y - radius
+        for (size_t n = nodes.size(); n-- > 1;)
+        {
+            if (!_plans[n].live)
+                continue;
+            const int radius = nodes[n].Radius();
+            for (int i : nodes[n].inputs)
+            {
+                _plans[i].halo = std::max(_plans[i].halo, _plans[n].halo + radius);
+                _plans[i].slots = std::max(_plans[i].slots, _plans[n].lag - _plans[i].lag + radius + 1);
+            }
+        }
+        _halo = _plans[0].halo;
+        _rowBytes = static_cast<size_t>(_cols + 2 * _pad) * _cn;
+    }
+
+    uint8_t *Line(NodeLines &lines, int n, int y) const
+    {
+        return lines.rows.data() + static_cast<size_t>(y % _plans[n].slots) * _rowBytes;
+    }
+
+    /**
+     * @brief Compute the output rows [top, bottom) of the sinks.
+     */
+    void RunBand(const FilterGraph &graph, const cv::Mat &input, std::vector<cv::Mat> &outputs, Band &band, int top, int bottom)
+    {
+        const std::vector<FilterNode> &nodes = graph.Nodes();
+        const int rows = input.rows;
+
+        band.nodes.resize(nodes.size());
+        int first = INT_MAX, last = INT_MIN;
+        for (size_t n = 0; n < nodes.size(); ++n)
+        {
+            const NodePlan &plan = _plans[n];
+            if (!plan.live)
+                continue;
+            NodeLines &lines = band.nodes[n];
+            lines.rows.resize(plan.slots * _rowBytes);
+            if (!plan.column.empty())
+                lines.sums.resize(nodes[n].kernel.size * _rowBytes);
+            lines.nextSum = INT_MIN;
+
+            first = std::min(first, std::max(0, top - plan.halo) + plan.lag);
+            last = std::max(last, std::min(rows, bottom + plan.halo) - 1 + plan.lag);
+        }
+
+        // At step t, node n computes its row t - lag: its inputs are far enough ahead
+        for (int t = first; t <= last; ++t)
+            for (size_t n = 0; n < nodes.size(); ++n)
+            {
+                const NodePlan &plan = _plans[n];
+                const int y = t - plan.lag;
+                if (!plan.live || y < std::max(0, top - plan.halo) || y >= std::min(rows, bottom + plan.halo))
+                    continue;
+
+                uint8_t *line = Line(band.nodes[n], static_cast<int>(n), y);
+                ComputeRow(nodes, band, static_cast<int>(n), y, rows, input, line);
+
+                if (y >= top && y < bottom)
+                    for (size_t o = 0; o < outputs.size(); ++o)
+                        if (graph.Outputs()[o] == static_cast<int>(n))
+                            std::memcpy(outputs[o].ptr(y), line + _pad * _cn, static_cast<size_t>(_cols) * _cn);
+            }
+    }
+
+    void ComputeRow(const std::vector<FilterNode> &nodes, Band &band, int n, int y, int rows, const cv::Mat &input, uint8_t *line)
+    {
+        const FilterNode &node = nodes[n];
+        const int begin = _pad * _cn;
+        const int end = (_pad + _cols) * _cn;
+        const int bytes = static_cast<int>(_rowBytes);
+
+        switch (node.type)
+        {
+        case FilterNode::Type::Input:
+            std::memcpy(line + begin, input.ptr(y), static_cast<size_t>(_cols) * _cn);
+            Replicate(line);
+            break;
+
+        case FilterNode::Type::Convolution:
+        {
+            const int i = node.inputs[0];
+            const int radius = node.kernel.Radius();
+            NodeLines &lines = band.nodes[n];
+            NodeLines &source = band.nodes[i];
+            const NodePlan &plan = _plans[n];
+            if (plan.column.empty())
+            {
+                band.window.resize(node.kernel.size);
+                for (int k = 0; k < node.kernel.size; ++k)
+                    band.window[k] = Line(source, i, std::clamp(y - radius + k, 0, rows - 1));
+                ConvolveRow(band.window.data(), line, begin, end, _cn, node.kernel);
+            }
+            else
+            {
+                // Horizontal sums of each input row once, the vertical pass combines them
+                const int size = node.kernel.size;
+                const int last = std::min(rows - 1, y + radius);
+                for (int j = std::max(lines.nextSum, std::max(0, y - radius)); j <= last; ++j)
+                    ConvolveHorizontal(Line(source, i, j), lines.sums.data() + static_cast<size_t>(j % size) * _rowBytes, begin, end, _cn, plan.row);
+                lines.nextSum = last + 1;
+
+                band.sumWindow.resize(size);
+                for (int k = 0; k < size; ++k)
+                    band.sumWindow[k] = lines.sums.data() + static_cast<size_t>(std::clamp(y - radius + k, 0, rows - 1) % size) * _rowBytes;
+                ConvolveVertical(band.sumWindow.data(), line, begin, end, plan.column, node.kernel);
+            }
+            Replicate(line);
+            break;
+        }
+
+        // The per-pixel passes run on the replicated pixels too
+        case FilterNode::Type::Threshold:
+        {
+            const uint8_t *source = Line(band.nodes[node.inputs[0]], node.inputs[0], y);
+            for (int b = 0; b < bytes; ++b)
+                line[b] = source[b] >= node.level ? 255 : 0;
+            break;
+        }
+
+        case FilterNode::Type::Blend:
+        {
+            const uint8_t *a = Line(band.nodes[node.inputs[0]], node.inputs[0], y);
+            const uint8_t *b = Line(band.nodes[node.inputs[1]], node.inputs[1], y);
+            for (int k = 0; k < bytes; ++k)
+                line[k] = cv::saturate_cast<uchar>(a[k] * node.weightA + b[k] * node.weightB + node.bias);
+            break;
+        }
+        }
+    }
+
+    /**
+     * @brief Copy the first and last pixels of a row over its padding.
+     */
+    void Replicate(uint8_t *line) const
+    {
+        const uint8_t *left = line + _pad * _cn;
+        const uint8_t *right = line + (_pad + _cols - 1) * _cn;
+        for (int p = 0; p < _pad; ++p)
+        {
+            std::memcpy(line + p * _cn, left, _cn);
+            std::memcpy(line + (_pad + _cols + p) * _cn, right, _cn);
+        }
+    }
+
+    std::vector<NodePlan> _plans;
+    std::vector<Band> _bands;
+    int _cn = 3;
+    int _cols = 0;
+    int _pad = 0;
+    int _halo = 0;
+    size_t _rowBytes = 0;
+};
+
+#endif // FilterGraph_hpp
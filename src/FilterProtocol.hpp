@@ -0,0 +1,284 @@
+#ifndef FilterProtocol_hpp
+#define FilterProtocol_hpp
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Wire format of the filter daemon (see FilterServer and FilterClient), over a UNIX stream socket.
+ *
+ * A request is a RequestHeader, the backend name (methodLength chars, empty for the default backend of the
+ * server), the kernelSize * kernelSize weights (float) and, for the inline transport, the width * height * 3
+ * bytes of the BGR8 image. For the shared memory transport, a memfd is attached to the header (SCM_RIGHTS):
+ * it holds the input at offset 0 and receives the output right after it (2 * width * height * 3 bytes).
+ * The segment must be sealed against shrinking (F_SEAL_SHRINK), so the peer cannot truncate it under the
+ * mapping of the server (SIGBUS).
+ *
+ * A response is a ResponseHeader, the error message (messageLength chars) and, for the inline transport of
+ * a successful request, the filtered pixels. Both sides run on the same machine: host byte order.
+ */
+namespace FilterProtocol
+{
+    const uint32_t Magic = 0x46434c47; // "GLCF"
+    const uint16_t Version = 1;
+
+    // Limits checked by the server before allocating anything
+    const uint32_t MaxSide = 1 << 15;
+    const uint32_t MaxKernelSize = 63;
+    const uint32_t MaxMethodLength = 64;
+
+    enum class Transport : uint16_t
+    {
+        Inline = 0,
+        SharedMemory = 1
+    };
+
+    struct RequestHeader
+    {
+        uint32_t magic = Magic;
+        uint16_t version = Version;
+        Transport transport = Transport::Inline;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t kernelSize = 0;
+        float divisor = 1.0f;
+        float bias = 0.0f;
+        uint32_t methodLength = 0;
+    };
+
+    struct ResponseHeader
+    {
+        uint32_t magic = Magic;
+        // 0 on success, the message holds the error otherwise
+        uint32_t status = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t messageLength = 0;
+        // Time spent filtering by the server (transfers excluded)
+        uint64_t filterNanoseconds = 0;
+    };
+
+    inline size_t ImageBytes(uint32_t width, uint32_t height)
+    {
+        return static_cast<size_t>(width) * height * 3;
+    }
+
+    /**
+     * @brief The socket of the daemon: $GL_COMPUTE_SOCKET, else $XDG_RUNTIME_DIR/gl-compute.sock, else /tmp/gl-compute-UID.sock.
+     */
+    inline std::string DefaultSocketPath()
+    {
+        if (const char *path = std::getenv("GL_COMPUTE_SOCKET"))
+            return path;
+        if (const char *runtime = std::getenv("XDG_RUNTIME_DIR"); runtime != nullptr && *runtime != '\0')
+            return std::string(runtime) + "/gl-compute.sock";
+        return "/tmp/gl-compute-" + std::to_string(getuid()) + ".sock";
+    }
+
+    /**
+     * @brief The address of a socket path.
+     *
+     * @throw std::runtime_error If the path does not fit in sun_path.
+     */
+    inline sockaddr_un Address(const std::string &path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("Socket path too long : " + path);
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    /**
+     * @brief Send every byte, with an optional file descriptor attached to the first one.
+     *
+     * @return false if the peer is gone or the socket failed.
+     */
+    inline bool Send(int socket, const void *data, size_t size, int fd = -1)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        if (fd >= 0 && size > 0)
+        {
+            iovec io{const_cast<char *>(bytes), size};
+            char control[CMSG_SPACE(sizeof(int))] = {};
+            msghdr message{};
+            message.msg_iov = &io;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+            ssize_t sent;
+            do
+                sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+            while (sent < 0 && errno == EINTR);
+            if (sent <= 0)
+                return false;
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+
+        while (size > 0)
+        {
+            const ssize_t sent = send(socket, bytes, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                return false;
+            bytes += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Receive exactly size bytes, and the file descriptor attached to them if any (-1 otherwise).
+     *
+     * @return false if the peer closed the connection or the socket failed (timeout included).
+     */
+    inline bool Receive(int socket, void *data, size_t size, int *fd = nullptr)
+    {
+        char *bytes = static_cast<char *>(data);
+        if (fd != nullptr)
+            *fd = -1;
+
+        while (size > 0)
+        {
+            iovec io{bytes, size};
+            char control[CMSG_SPACE(sizeof(int))] = {};
+            msghdr message{};
+            message.msg_iov = &io;
+            message.msg_iovlen = 1;
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+
+            const ssize_t received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+            if (received < 0 && errno == EINTR)
+                continue;
+            if (received <= 0)
+                return false;
+
+            for (cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+                if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+                {
+                    int receivedFd;
+                    std::memcpy(&receivedFd, CMSG_DATA(header), sizeof(int));
+                    if (fd != nullptr && *fd < 0)
+                        *fd = receivedFd;
+                    else
+                        close(receivedFd);
+                }
+
+            bytes += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    /**
+     * Shared memory segment (memfd) mapped in this process, exchanged by file descriptor.
+     */
+    class SharedMemory
+    {
+    public:
+        SharedMemory() : _fd(-1), _data(nullptr), _size(0) {}
+
+        ~SharedMemory() { Release(); }
+
+        SharedMemory(const SharedMemory &) = delete;
+        SharedMemory &operator=(const SharedMemory &) = delete;
+
+        /**
+         * @brief Create a segment of at least size bytes (kept when already large enough).
+         *
+         * @throw std::runtime_error If the segment cannot be created or mapped.
+         */
+        void Allocate(size_t size)
+        {
+            if (_data != nullptr && _size >= size)
+                return;
+            Release();
+
+            _fd = memfd_create("gl-compute-job", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if (_fd < 0 || ftruncate(_fd, static_cast<off_t>(size)) != 0 || fcntl(_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) != 0)
+                throw std::runtime_error(std::string("Cannot create the shared memory : ") + std::strerror(errno));
+            Map(size);
+        }
+
+        /**
+         * @brief Take a segment received from a peer (the descriptor is owned from now on), see Map().
+         */
+        void Attach(int fd)
+        {
+            Release();
+            _fd = fd;
+        }
+
+        /**
+         * @brief Map the first size bytes of the attached segment.
+         *
+         * @throw std::runtime_error If the segment can still shrink, is smaller than size bytes or cannot be mapped.
+         */
+        void Map(size_t size)
+        {
+            // Checked before the size: once sealed, the size can only grow
+            const int seals = _fd >= 0 ? fcntl(_fd, F_GET_SEALS) : -1;
+            if (seals < 0 || (seals & F_SEAL_SHRINK) == 0)
+                throw std::runtime_error("Shared memory not sealed against shrinking");
+
+            struct stat status;
+            if (fstat(_fd, &status) != 0 || static_cast<size_t>(status.st_size) < size)
+                throw std::runtime_error("Shared memory smaller than the image");
+            if (_data != nullptr)
+                munmap(_data, _size);
+
+            void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+            if (data == MAP_FAILED)
+            {
+                _data = nullptr;
+                _size = 0;
+                throw std::runtime_error(std::string("Cannot map the shared memory : ") + std::strerror(errno));
+            }
+            _data = static_cast<uint8_t *>(data);
+            _size = size;
+        }
+
+        void Release()
+        {
+            if (_data != nullptr)
+                munmap(_data, _size);
+            if (_fd >= 0)
+                close(_fd);
+            _fd = -1;
+            _data = nullptr;
+            _size = 0;
+        }
+
+        int Fd() const { return _fd; }
+        uint8_t *Data() const { return _data; }
+        size_t Size() const { return _size; }
+
+    private:
+        int _fd;
+        uint8_t *_data;
+        size_t _size;
+    };
+}
+
+#endif // FilterProtocol_hpp
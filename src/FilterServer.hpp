@@ -0,0 +1,221 @@
+#ifndef FilterServer_hpp
+#define FilterServer_hpp
+
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "FilterBackend.hpp"
+#include "FilterProtocol.hpp"
+#include "Kernel.hpp"
+
+/**
+ * Filter daemon: keeps the GL context, the compiled programs and the tuned CPU tiles of the process warm
+ * and serves filter jobs over a UNIX socket (see FilterProtocol), until SIGINT / SIGTERM.
+ *
+ * The requests are served one at a time on the calling thread, the one holding the GL context, from any
+ * number of connected clients. Small images travel inline in the socket, large ones in a shared memory
+ * segment of the client, filtered in place without any copy through the socket.
+ */
+class FilterServer
+{
+public:
+    /**
+     * @param backends The filter backends.
+     * @param defaultMethod The backend of the requests naming none.
+     */
+    FilterServer(const FilterBackendRegistry &backends, const std::string &defaultMethod)
+        : _backends(backends), _defaultMethod(defaultMethod), _requests(0), _failures(0), _filterSeconds(0.0)
+    {
+        // Fail at startup rather than on the first request
+        _backends.Get(defaultMethod);
+    }
+
+    /**
+     * @brief Listen on a socket path (a stale socket file is replaced) and serve until SIGINT / SIGTERM.
+     *
+     * @throw std::runtime_error If the socket cannot be created.
+     */
+    void Run(const std::string &path)
+    {
+        const sockaddr_un address = FilterProtocol::Address(path);
+        const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listener < 0)
+            throw std::runtime_error("Cannot create the socket");
+
+        unlink(path.c_str());
+        if (bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0)
+        {
+            close(listener);
+            throw std::runtime_error("Cannot listen on " + path);
+        }
+
+        Stopping() = 0;
+        std::signal(SIGINT, OnSignal);
+        std::signal(SIGTERM, OnSignal);
+        std::cout << "[FilterServer] Listening : " << path << " (default backend " << _defaultMethod << ")" << std::endl;
+
+        std::vector<pollfd> sockets = {{listener, POLLIN, 0}};
+        while (!Stopping())
+        {
+            // Timeout so a signal received outside poll() is noticed
+            if (poll(sockets.data(), sockets.size(), 500) <= 0)
+                continue;
+
+            for (size_t i = sockets.size(); i-- > 1;)
+            {
+                if (sockets[i].revents == 0)
+                    continue;
+                if ((sockets[i].revents & POLLIN) == 0 || !Serve(sockets[i].fd))
+                {
+                    close(sockets[i].fd);
+                    sockets.erase(sockets.begin() + i);
+                }
+            }
+
+            if (sockets[0].revents & POLLIN)
+            {
+                const int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client >= 0)
+                {
+                    // A client stalling in the middle of a request must not block the others forever
+                    const timeval timeout{5, 0};
+                    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                    sockets.push_back({client, POLLIN, 0});
+                }
+            }
+        }
+
+        for (const pollfd &entry : sockets)
+            close(entry.fd);
+        unlink(path.c_str());
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+
+        std::cout << "[FilterServer] Stopped : " << _requests << " requests (" << _failures << " failed), "
+                  << (_requests > 0 ? _filterSeconds * 1e3 / _requests : 0.0) << " ms filtering per request" << std::endl;
+    }
+
+private:
+    static volatile std::sig_atomic_t &Stopping()
+    {
+        static volatile std::sig_atomic_t stopping = 0;
+        return stopping;
+    }
+
+    static void OnSignal(int)
+    {
+        Stopping() = 1;
+    }
+
+    /**
+     * @brief Read one request of a client, filter it and answer.
+     *
+     * @return false if the connection must be closed (peer gone, malformed request).
+     */
+    bool Serve(int client)
+    {
+        using namespace FilterProtocol;
+
+        // The segment attached to the header, if any, is released with the request
+        int fd = -1;
+        RequestHeader request;
+        const bool received = Receive(client, &request, sizeof(request), &fd);
+        SharedMemory shared;
+        if (fd >= 0)
+            shared.Attach(fd);
+        if (!received)
+            return false;
+
+        // Malformed headers cannot be skipped: the connection is dropped
+        if (request.magic != Magic || request.version != Version || request.methodLength > MaxMethodLength ||
+            request.kernelSize > MaxKernelSize || request.width > MaxSide || request.height > MaxSide ||
+            (request.transport != Transport::Inline && request.transport != Transport::SharedMemory))
+        {
+            std::cout << "[FilterServer] Invalid request, closing the connection" << std::endl;
+            return false;
+        }
+
+        std::string method(request.methodLength, '\0');
+        std::vector<float> weights(static_cast<size_t>(request.kernelSize) * request.kernelSize);
+        const size_t bytes = ImageBytes(request.width, request.height);
+        if (!Receive(client, method.data(), method.size()) || !Receive(client, weights.data(), weights.size() * sizeof(float)))
+            return false;
+
+        cv::Mat input, output;
+        if (request.transport == Transport::Inline)
+        {
+            input.create(static_cast<int>(request.height), static_cast<int>(request.width), CV_8UC3);
+            if (!Receive(client, input.data, bytes))
+                return false;
+        }
+
+        ResponseHeader response;
+        response.width = request.width;
+        response.height = request.height;
+        std::string error;
+        try
+        {
+            if (request.width == 0 || request.height == 0)
+                throw std::runtime_error("Empty image");
+
+            if (request.transport == Transport::SharedMemory)
+            {
+                if (fd < 0)
+                    throw std::runtime_error("Shared memory request without a segment");
+                shared.Map(2 * bytes);
+                input = cv::Mat(static_cast<int>(request.height), static_cast<int>(request.width), CV_8UC3, shared.Data());
+                output = cv::Mat(input.rows, input.cols, CV_8UC3, shared.Data() + bytes);
+            }
+
+            const Kernel kernel("request", static_cast<int>(request.kernelSize), weights, request.divisor, request.bias);
+            IFilterBackend &backend = _backends.Get(method.empty() ? _defaultMethod : method);
+
+            const auto t0 = std::chrono::steady_clock::now();
+            cv::Mat result = output;
+            backend.Filter(input, result, kernel);
+            if (result.data != output.data)
+            {
+                if (output.empty())
+                    output = result;
+                else
+                    result.copyTo(output);
+            }
+            const auto t1 = std::chrono::steady_clock::now();
+
+            response.filterNanoseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            _filterSeconds += std::chrono::duration<double>(t1 - t0).count();
+        }
+        catch (const std::exception &exception)
+        {
+            error = exception.what();
+            response.status = 1;
+            response.messageLength = static_cast<uint32_t>(error.size());
+            _failures++;
+        }
+        _requests++;
+
+        const bool inlinePixels = response.status == 0 && request.transport == Transport::Inline;
+        return Send(client, &response, sizeof(response)) && Send(client, error.data(), error.size()) &&
+               (!inlinePixels || Send(client, output.data, bytes));
+    }
+
+private:
+    const FilterBackendRegistry &_backends;
+    std::string _defaultMethod;
+
+    int _requests;
+    int _failures;
+    double _filterSeconds;
+};
+
+#endif // FilterServer_hpp
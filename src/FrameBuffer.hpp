@@ -43,6 +43,32 @@ public:
         std::cout << "[FrameBuffer] Created : " << _ID << std::endl;
     }
 
+    /**
+     * @brief Create the FrameBuffer on first use, afterwards only re-specify the color
+     * storage when the size changes (the attachment stays valid).
+     *
+     * @param width The width of the color attachment.
+     * @param height The height of the color attachment.
+     * @param internalFormat The internal format of the color attachment (GL_RGB, GL_RGBA32F, ...).
+     */
+    void Allocate(int width, int height, GLint internalFormat = GL_RGB)
+    {
+        if (_ID == 0)
+        {
+            Create(width, height);
+            if (internalFormat == GL_RGB)
+                return;
+        }
+
+        if (!_color_0.Allocate(width, height, internalFormat))
+            return;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, _ID);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            throw std::runtime_error("Incomplete FrameBuffer");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
     void Bind()
     {
         glBindFramebuffer(GL_FRAMEBUFFER, _ID);
@@ -0,0 +1,264 @@
+#ifndef FramePipeline_hpp
+#define FramePipeline_hpp
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+
+#include "GL.hpp"
+#include "GpuFilterContext.hpp"
+#include "Texture.hpp"
+
+/**
+ * Measurements of a FramePipeline run.
+ *
+ * The occupancy of a stage is the share of the wall time the host spent on it, including the
+ * time blocked on its fences: the stage closest to 100% is the bottleneck.
+ *    # Upload: BGR -> BGRA conversion straight into the mapped unpack buffer, texture update from the buffer.
+ *    # Compute: dispatch, then waiting on the compute fence of the frame being collected.
+ *    # Download: waiting on the download fence, mapping the pack buffer and handing it to the sink.
+ */
+struct PipelineStats
+{
+    int frames = 0;
+    double seconds = 0.0;
+    double steadyFps = 0.0;
+    double upload = 0.0;
+    double compute = 0.0;
+    double download = 0.0;
+
+    void Print(std::ostream &out) const
+    {
+        const std::ios_base::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+
+        out << std::fixed << std::setprecision(1);
+        out << "Frames: " << frames << " in " << seconds * 1000.0 << " ms" << std::endl;
+        out << "Steady state: " << steadyFps << " frames/s" << std::endl;
+        out << "Occupancy: upload " << 100.0 * upload / seconds << "%"
+            << ", compute " << 100.0 * compute / seconds << "%"
+            << ", download " << 100.0 * download / seconds << "%" << std::endl;
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+/**
+ * Triple-buffered streaming of frames through the compute shader.
+ *
+ * Three frames are in flight: while frame N is uploaded through its pixel unpack buffer, frame N - 1 is
+ * computed and frame N - 2 is read back through its pixel pack buffer. Each frame owns a slot (buffers,
+ * textures and fences) that is reused every three frames. The stages only synchronize through
+ * glFenceSync / glClientWaitSync, never glFinish.
+ *
+ * @remark Must be used from the thread owning the GL context.
+ */
+class FramePipeline
+{
+public:
+    static const int depth = 3;
+
+    explicit FramePipeline(GpuFilterContext &gpu) : _gpu(gpu) {}
+
+    ~FramePipeline()
+    {
+        for (Slot &slot : _slots)
+        {
+            if (slot.computeFence != nullptr)
+                glDeleteSync(slot.computeFence);
+            if (slot.downloadFence != nullptr)
+                glDeleteSync(slot.downloadFence);
+            if (slot.unpack != 0)
+                glDeleteBuffers(1, &slot.unpack);
+            if (slot.pack != 0)
+                glDeleteBuffers(1, &slot.pack);
+        }
+    }
+
+    FramePipeline(const FramePipeline &) = delete;
+    FramePipeline &operator=(const FramePipeline &) = delete;
+
+    /**
+     * @brief Stream frames until the source runs dry.
+     *
+     * @param source Fills the next 8-bit BGR frame, returns false at the end of the stream.
+     * @param sink Receives the filtered frames in order. The image wraps the mapped pack buffer
+     * and is only valid during the call.
+     * @return The measurements of the run.
+     */
+    PipelineStats Run(const std::function<bool(cv::Mat &)> &source, const std::function<void(const cv::Mat &)> &sink)
+    {
+        typedef std::chrono::steady_clock clock;
+        auto seconds = [](clock::duration d)
+        { return std::chrono::duration<double>(d).count(); };
+
+        PipelineStats stats;
+        const auto start = clock::now();
+        auto firstOut = start;
+
+        cv::Mat frame;
+        int submitted = 0, collected = 0;
+        bool more = true;
+        while (true)
+        {
+            // Stage 1 & 2: upload and dispatch the next frame, its slot was freed three frames ago
+            more = more && source(frame);
+            if (more)
+            {
+                Slot &slot = _slots[submitted % depth];
+
+                auto t0 = clock::now();
+                Upload(slot, frame);
+                auto t1 = clock::now();
+                Compute(slot);
+                auto t2 = clock::now();
+
+                stats.upload += seconds(t1 - t0);
+                stats.compute += seconds(t2 - t1);
+                ++submitted;
+            }
+
+            // Stage 3: collect the oldest frame once the pipeline is full (or draining)
+            if (collected < submitted && (!more || submitted - collected == depth))
+            {
+                Collect(_slots[collected % depth], sink, stats);
+                if (collected++ == 0)
+                    firstOut = clock::now();
+            }
+            else if (!more)
+                break;
+        }
+
+        const auto end = clock::now();
+        stats.frames = collected;
+        stats.seconds = seconds(end - start);
+
+        // Steady state: the rate between the first and the last output, the pipeline fill is excluded
+        if (collected > 1)
+            stats.steadyFps = (collected - 1) / seconds(end - firstOut);
+        else if (collected == 1)
+            stats.steadyFps = 1.0 / stats.seconds;
+
+        return stats;
+    }
+
+private:
+    struct Slot
+    {
+        GLuint unpack = 0;
+        GLuint pack = 0;
+        GLsizeiptr unpackSize = 0;
+        GLsizeiptr packSize = 0;
+        Texture input;
+        Texture output;
+        GLsync computeFence = nullptr;
+        GLsync downloadFence = nullptr;
+    };
+
+    /**
+     * @brief Make sure a buffer exists and holds size bytes (storage re-specified only on change).
+     */
+    static void Reserve(GLenum target, GLuint &buffer, GLsizeiptr &current, GLsizeiptr size, GLenum usage)
+    {
+        if (buffer == 0)
+            glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        if (current != size)
+        {
+            glBufferData(target, size, nullptr, usage);
+            current = size;
+        }
+    }
+
+    /**
+     * @brief Convert the frame to BGRA directly into the unpack buffer, then update the input texture from it.
+     */
+    void Upload(Slot &slot, const cv::Mat &frame)
+    {
+        const int width = frame.cols;
+        const int height = frame.rows;
+        const GLsizeiptr size = static_cast<GLsizeiptr>(width) * height * 4;
+
+        Reserve(GL_PIXEL_UNPACK_BUFFER, slot.unpack, slot.unpackSize, size, GL_STREAM_DRAW);
+        void *mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped == nullptr)
+            throw std::runtime_error("FramePipeline glMapBufferRange failed");
+
+        cv::Mat staged(height, width, CV_8UC4, mapped);
+        cv::cvtColor(frame, staged, cv::COLOR_BGR2BGRA);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        slot.input.Allocate(width, height, GL_RGBA8);
+        slot.output.Allocate(width, height, GL_RGBA8);
+
+        // The pixels come from the bound unpack buffer (offset 0)
+        slot.input.Bind();
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+        slot.input.UnBind();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    /**
+     * @brief Dispatch the filter and queue the download into the pack buffer, each followed by a fence.
+     */
+    void Compute(Slot &slot)
+    {
+        _gpu.DispatchCompute(slot.input, slot.output);
+        slot.computeFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        const GLsizeiptr size = static_cast<GLsizeiptr>(slot.output.Width()) * slot.output.Height() * 3;
+        Reserve(GL_PIXEL_PACK_BUFFER, slot.pack, slot.packSize, size, GL_STREAM_READ);
+        slot.output.Bind();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_BGR, GL_UNSIGNED_BYTE, nullptr);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        slot.output.UnBind();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.downloadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        // Start the GPU work now, the fences are waited on frames later
+        glFlush();
+    }
+
+    /**
+     * @brief Wait for the frame of a slot and hand the mapped result to the sink.
+     */
+    void Collect(Slot &slot, const std::function<void(const cv::Mat &)> &sink, PipelineStats &stats)
+    {
+        typedef std::chrono::steady_clock clock;
+
+        auto t0 = clock::now();
+        WaitSync(slot.computeFence);
+        auto t1 = clock::now();
+        WaitSync(slot.downloadFence);
+
+        glDeleteSync(slot.computeFence);
+        glDeleteSync(slot.downloadFence);
+        slot.computeFence = nullptr;
+        slot.downloadFence = nullptr;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pack);
+        void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.packSize, GL_MAP_READ_BIT);
+        if (mapped == nullptr)
+            throw std::runtime_error("FramePipeline glMapBufferRange failed");
+
+        sink(cv::Mat(slot.output.Height(), slot.output.Width(), CV_8UC3, mapped));
+
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        auto t2 = clock::now();
+
+        stats.compute += std::chrono::duration<double>(t1 - t0).count();
+        stats.download += std::chrono::duration<double>(t2 - t1).count();
+    }
+
+private:
+    GpuFilterContext &_gpu;
+    std::array<Slot, depth> _slots;
+};
+
+#endif // FramePipeline_hpp
@@ -0,0 +1,368 @@
+#ifndef FrameRing_hpp
+#define FrameRing_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <opencv2/opencv.hpp>
+
+/**
+ * Ring of fixed-size BGR8 frames in POSIX shared memory (shm_open), exchanged between two processes
+ * without copy: the producer writes a frame straight into a slot, the consumer reads it from the same
+ * pages, e.g. to upload it to the GPU or to filter it into the slot of another ring.
+ *
+ * One producer and one consumer per ring. The header holds two free-running counters, the frames
+ * published (head) and released (tail): each side only writes its own counter, so the ring is lock-free,
+ * and a side finding the ring empty / full sleeps on the counter of the other one with a futex (woken
+ * only when it announced it sleeps, the fast path makes no system call).
+ *
+ * The header also holds the process ids of the creator and of the process that opened the ring: a side
+ * waiting for a peer that exited without closing the ring (crash) gives up instead of blocking forever.
+ *
+ * Layout: the header and the slot descriptions in the first pages, then the slots, each page-aligned
+ * holding width * height * 3 bytes (continuous rows).
+ */
+class FrameRing
+{
+public:
+    /**
+     * @brief Create a ring (replacing a ring of the same name), removed from the namespace by the destructor.
+     *
+     * @param name The shared memory object, "/name".
+     * @param width The frame width.
+     * @param height The frame height.
+     * @param slots The frames in the ring.
+     * @throw std::runtime_error If the geometry is invalid or the ring cannot be created.
+     */
+    FrameRing(const std::string &name, int width, int height, int slots) : _name(name), _owner(true), _fd(-1), _data(nullptr), _size(0), _header(nullptr), _current(0)
+    {
+        if (width < 1 || height < 1 || slots < 1 || slots > MaxSlots)
+            throw std::runtime_error("Invalid frame ring geometry for " + name);
+
+        const size_t slotBytes = PageAligned(static_cast<size_t>(width) * height * 3);
+        const size_t dataOffset = PageAligned(sizeof(Header));
+        _size = dataOffset + slotBytes * slots;
+
+        shm_unlink(name.c_str());
+        _fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (_fd < 0 || ftruncate(_fd, static_cast<off_t>(_size)) != 0)
+        {
+            const std::string reason = std::strerror(errno);
+            Unmap();
+            throw std::runtime_error("Cannot create the frame ring " + name + " : " + reason);
+        }
+        Map();
+
+        // The magic is written last: a consumer opening the ring meanwhile sees an invalid ring
+        _header = new (_data) Header();
+        _header->width = static_cast<uint32_t>(width);
+        _header->height = static_cast<uint32_t>(height);
+        _header->slots = static_cast<uint32_t>(slots);
+        _header->slotBytes = slotBytes;
+        _header->dataOffset = dataOffset;
+        _header->creatorPid.store(getpid(), std::memory_order_relaxed);
+        _header->magic.store(Magic, std::memory_order_release);
+    }
+
+    /**
+     * @brief Open a ring created by another process.
+     *
+     * @param name The shared memory object, "/name".
+     * @throw std::runtime_error If the ring does not exist or is not a frame ring.
+     */
+    explicit FrameRing(const std::string &name) : _name(name), _owner(false), _fd(-1), _data(nullptr), _size(0), _header(nullptr), _current(0)
+    {
+        _fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        struct stat status;
+        if (_fd < 0 || fstat(_fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(Header))
+        {
+            Unmap();
+            throw std::runtime_error("Cannot open the frame ring " + name);
+        }
+        _size = static_cast<size_t>(status.st_size);
+        Map();
+
+        _header = reinterpret_cast<Header *>(_data);
+        if (_header->magic.load(std::memory_order_acquire) != Magic || _header->version != Version || !ValidGeometry())
+        {
+            Unmap();
+            throw std::runtime_error("Not a frame ring : " + name);
+        }
+        _header->openerPid.store(getpid(), std::memory_order_release);
+    }
+
+    ~FrameRing()
+    {
+        Unmap();
+    }
+
+    FrameRing(const FrameRing &) = delete;
+    FrameRing &operator=(const FrameRing &) = delete;
+
+    int Width() const { return static_cast<int>(_header->width); }
+    int Height() const { return static_cast<int>(_header->height); }
+    int Slots() const { return static_cast<int>(_header->slots); }
+    const std::string &Name() const { return _name; }
+
+    /**
+     * @brief Producer: wait for a free slot and map a frame on it (no copy, no allocation).
+     *
+     * @param frame The frame to write, valid until Publish().
+     * @param timeoutMs The longest wait, negative for none.
+     * @return false if the ring is closed, the consumer exited or the wait timed out.
+     */
+    bool Acquire(cv::Mat &frame, int timeoutMs = -1)
+    {
+        const uint32_t head = _header->head.load(std::memory_order_relaxed);
+        if (!WaitWhile(_header->tail, _header->producerWaiting, [&](uint32_t tail)
+                       { return head - tail >= _header->slots; },
+                       timeoutMs))
+            return false;
+
+        _current = head;
+        frame = SlotFrame(head);
+        return true;
+    }
+
+    /**
+     * @brief Producer: hand the frame of Acquire() to the consumer.
+     *
+     * @param timestamp Any value travelling with the frame (capture time, ...).
+     */
+    void Publish(uint64_t timestamp = 0)
+    {
+        _header->timestamps[_current % _header->slots] = timestamp;
+        Advance(_header->head, _header->consumerWaiting);
+    }
+
+    /**
+     * @brief Consumer: wait for the next frame and map it (no copy).
+     *
+     * @param frame The frame to read, valid until Release().
+     * @param timestamp The value published with the frame (optional).
+     * @param timeoutMs The longest wait, negative for none.
+     * @return false if the ring is closed and drained, the producer exited or the wait timed out.
+     */
+    bool Next(cv::Mat &frame, uint64_t *timestamp = nullptr, int timeoutMs = -1)
+    {
+        const uint32_t tail = _header->tail.load(std::memory_order_relaxed);
+        if (!WaitWhile(_header->head, _header->consumerWaiting, [&](uint32_t head)
+                       { return head == tail; },
+                       timeoutMs))
+            return false;
+
+        _current = tail;
+        frame = SlotFrame(tail);
+        if (timestamp != nullptr)
+            *timestamp = _header->timestamps[tail % _header->slots];
+        return true;
+    }
+
+    /**
+     * @brief Consumer: give the slot of the frame of Next() back to the producer.
+     */
+    void Release()
+    {
+        Advance(_header->tail, _header->producerWaiting);
+    }
+
+    /**
+     * @brief No more frames: the consumer drains the published ones, then Next() returns false.
+     */
+    void Close()
+    {
+        _header->closed.store(1, std::memory_order_seq_cst);
+        Futex(&_header->head, FUTEX_WAKE, INT_MAX, nullptr);
+        Futex(&_header->tail, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+
+    bool Closed() const { return _header->closed.load(std::memory_order_acquire) != 0; }
+
+    /**
+     * @brief Whether the process on the other side of the ring exited (false while it has not opened it yet).
+     */
+    bool PeerGone() const
+    {
+        const pid_t peer = _owner ? _header->openerPid.load(std::memory_order_acquire) : _header->creatorPid.load(std::memory_order_acquire);
+        return peer > 0 && kill(peer, 0) != 0 && errno == ESRCH;
+    }
+
+private:
+    static const uint32_t Magic = 0x474e4952; // "RING"
+    static const uint32_t Version = 2;
+    static const int MaxSlots = 64;
+
+    // While waiting, the state is checked at least this often (ring closed, peer process gone)
+    static const int PollMs = 100;
+
+    struct Header
+    {
+        std::atomic<uint32_t> magic{0};
+        uint32_t version = Version;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t slots = 0;
+        uint64_t slotBytes = 0;
+        uint64_t dataOffset = 0;
+        uint64_t timestamps[MaxSlots] = {};
+        std::atomic<int32_t> creatorPid{0};
+        std::atomic<int32_t> openerPid{0};
+
+        // Each counter on its own cache line, written by one side only
+        alignas(64) std::atomic<uint32_t> head{0};
+        std::atomic<uint32_t> consumerWaiting{0};
+        alignas(64) std::atomic<uint32_t> tail{0};
+        std::atomic<uint32_t> producerWaiting{0};
+        alignas(64) std::atomic<uint32_t> closed{0};
+    };
+
+    /**
+     * @brief Whether the geometry read from the header fits the mapping: each slot holds a frame, the slots
+     * follow the header and end within the object (no overflow).
+     */
+    bool ValidGeometry() const
+    {
+        const Header &header = *_header;
+        if (header.width == 0 || header.height == 0 || header.slots == 0 || header.slots > MaxSlots)
+            return false;
+        const uint64_t frameBytes = static_cast<uint64_t>(header.width) * header.height * 3;
+        if (header.slotBytes < frameBytes || header.dataOffset < sizeof(Header) || header.dataOffset > _size)
+            return false;
+        return header.slotBytes <= (_size - header.dataOffset) / header.slots;
+    }
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free && sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                  "The futexes need plain 32-bit atomics");
+
+    static size_t PageAligned(size_t size)
+    {
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return (size + page - 1) / page * page;
+    }
+
+    static long Futex(std::atomic<uint32_t> *word, int op, uint32_t value, const timespec *timeout)
+    {
+        return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, value, timeout, nullptr, 0);
+    }
+
+    cv::Mat SlotFrame(uint32_t index) const
+    {
+        uint8_t *slot = _data + _header->dataOffset + _header->slotBytes * (index % _header->slots);
+        return cv::Mat(Height(), Width(), CV_8UC3, slot);
+    }
+
+    /**
+     * @brief Publish one more frame / slot and wake the other side if it sleeps.
+     */
+    static void Advance(std::atomic<uint32_t> &counter, std::atomic<uint32_t> &waiting)
+    {
+        counter.fetch_add(1, std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_seq_cst) != 0)
+            Futex(&counter, FUTEX_WAKE, 1, nullptr);
+    }
+
+    /**
+     * @brief Wait while blocked(counter of the other side): spin a little, then sleep on the futex.
+     *
+     * @return false if the ring is closed or its peer gone (and still blocked), or the wait timed out.
+     */
+    template <typename Blocked>
+    bool WaitWhile(std::atomic<uint32_t> &counter, std::atomic<uint32_t> &waiting, Blocked blocked, int timeoutMs)
+    {
+        for (int spin = 0; spin < 64; ++spin)
+            if (!blocked(counter.load(std::memory_order_acquire)))
+                return true;
+
+        timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (true)
+        {
+            // Announce the sleep before checking again, so the other side cannot miss it
+            waiting.store(1, std::memory_order_seq_cst);
+            const uint32_t observed = counter.load(std::memory_order_seq_cst);
+            if (!blocked(observed))
+                break;
+            if (Closed() || PeerGone())
+            {
+                waiting.store(0, std::memory_order_relaxed);
+                return false;
+            }
+
+            int waitMs = PollMs;
+            if (timeoutMs >= 0)
+            {
+                timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                const long elapsedMs = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+                if (elapsedMs >= timeoutMs)
+                {
+                    waiting.store(0, std::memory_order_relaxed);
+                    return false;
+                }
+                waitMs = std::min<long>(waitMs, timeoutMs - elapsedMs);
+            }
+
+            const timespec timeout{waitMs / 1000, (waitMs % 1000) * 1000000L};
+            Futex(&counter, FUTEX_WAIT, observed, &timeout);
+        }
+
+        waiting.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return true;
+    }
+
+    void Map()
+    {
+        void *data = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (data == MAP_FAILED)
+        {
+            const std::string reason = std::strerror(errno);
+            Unmap();
+            throw std::runtime_error("Cannot map the frame ring " + _name + " : " + reason);
+        }
+        _data = static_cast<uint8_t *>(data);
+    }
+
+    /**
+     * @brief Unmap the ring (and remove its name when created here).
+     */
+    void Unmap()
+    {
+        if (_data != nullptr)
+            munmap(_data, _size);
+        if (_fd >= 0)
+            close(_fd);
+        if (_owner && _fd >= 0)
+            shm_unlink(_name.c_str());
+        _data = nullptr;
+        _header = nullptr;
+        _fd = -1;
+    }
+
+private:
+    std::string _name;
+    bool _owner;
+    int _fd;
+    uint8_t *_data;
+    size_t _size;
+    Header *_header;
+
+    // Counter value of the frame between Acquire() / Next() and Publish() / Release()
+    uint32_t _current;
+};
+
+#endif // FrameRing_hpp
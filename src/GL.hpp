@@ -4,6 +4,7 @@
 #include <GL/glew.h>
 
 #include <iostream>
+#include <stdexcept>
 
 [[maybe_unused]]
 static void PrintGLInfo()
@@ -47,4 +48,25 @@ static void CheckGLError(const std::string &step)
         std::cout << step << " : " << GetErrorString(err) << std::endl;
 }
 
+/**
+ * @brief Block until a fence is signaled (the first wait flushes the pending commands).
+ *
+ * @param sync The fence to wait on.
+ */
+[[maybe_unused]]
+static void WaitSync(GLsync sync)
+{
+    // Wait in 1 ms steps
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true)
+    {
+        GLenum status = glClientWaitSync(sync, flags, 1000000);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+            return;
+        if (status == GL_WAIT_FAILED)
+            throw std::runtime_error("glClientWaitSync failed");
+        flags = 0;
+    }
+}
+
 #endif // GL_hpp
\ No newline at end of file
@@ -0,0 +1,287 @@
+#ifndef GLContext_hpp
+#define GLContext_hpp
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// No X11 types in the EGL headers, the EGL backend never talks to a window system
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+/**
+ * Window system used to obtain the OpenGL 4.3 core context.
+ *    # GLFW: a hidden 1x1 window, needs a display server.
+ *    # EGL: headless, surfaceless (EGL_MESA_platform_surfaceless), device (EGL_EXT_platform_device)
+ *      or default display with a 1x1 pbuffer. Works with Mesa llvmpipe on CPU-only hosts.
+ *    # Auto: GLFW when a display server is advertised (DISPLAY / WAYLAND_DISPLAY), EGL otherwise.
+ */
+enum class ContextBackend
+{
+    Auto,
+    GLFW,
+    EGL
+};
+
+/**
+ * @brief Parse a backend name (auto, glfw or egl).
+ *
+ * @param name The name to parse.
+ * @param backend The parsed backend.
+ * @return true if the name is known.
+ */
+[[maybe_unused]]
+static bool ParseContextBackend(const std::string &name, ContextBackend &backend)
+{
+    if (name == "auto")
+        backend = ContextBackend::Auto;
+    else if (name == "glfw")
+        backend = ContextBackend::GLFW;
+    else if (name == "egl")
+        backend = ContextBackend::EGL;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * Owner of the OpenGL context (and of the GLEW initialization).
+ */
+class GLContext
+{
+public:
+    GLContext() : _window(nullptr), _display(EGL_NO_DISPLAY), _surface(EGL_NO_SURFACE), _context(EGL_NO_CONTEXT), _creationMs(0.0) {}
+    ~GLContext() { Destroy(); }
+
+    GLContext(const GLContext &) = delete;
+    GLContext &operator=(const GLContext &) = delete;
+
+    /**
+     * @brief Create a 4.3 core context, make it current and initialise GLEW.
+     * The creation time is measured and printed.
+     *
+     * @param backend The window system to use.
+     * @throw std::runtime_error If the context cannot be created.
+     */
+    void Create(ContextBackend backend = ContextBackend::Auto)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+
+        if (backend == ContextBackend::Auto)
+        {
+            const char *x11 = std::getenv("DISPLAY");
+            const char *wayland = std::getenv("WAYLAND_DISPLAY");
+            const bool hasDisplay = (x11 != nullptr && *x11 != '\0') || (wayland != nullptr && *wayland != '\0');
+            backend = hasDisplay ? ContextBackend::GLFW : ContextBackend::EGL;
+        }
+
+        if (backend == ContextBackend::GLFW)
+            CreateGLFW();
+        else
+            CreateEGL();
+
+        InitGLEW();
+
+        auto t1 = std::chrono::steady_clock::now();
+        _creationMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+
+        std::cout << "[GLContext] " << _description << " created in " << _creationMs << " ms" << std::endl;
+    }
+
+    /**
+     * @brief Make the context current on the calling thread.
+     */
+    void MakeCurrent()
+    {
+        if (_window != nullptr)
+            glfwMakeContextCurrent(_window);
+        else if (_context != EGL_NO_CONTEXT)
+            eglMakeCurrent(_display, _surface, _surface, _context);
+    }
+
+    void Destroy()
+    {
+        if (_window != nullptr)
+        {
+            glfwDestroyWindow(_window);
+            glfwTerminate();
+            _window = nullptr;
+        }
+
+        if (_display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (_context != EGL_NO_CONTEXT)
+                eglDestroyContext(_display, _context);
+            if (_surface != EGL_NO_SURFACE)
+                eglDestroySurface(_display, _surface);
+            eglTerminate(_display);
+            _display = EGL_NO_DISPLAY;
+            _surface = EGL_NO_SURFACE;
+            _context = EGL_NO_CONTEXT;
+        }
+    }
+
+    /**
+     * @brief The backend and platform actually used (e.g. "EGL surfaceless").
+     */
+    const std::string &Description() const { return _description; }
+
+    /**
+     * @brief Time taken by Create(), GLEW initialization included.
+     */
+    double CreationMs() const { return _creationMs; }
+
+private:
+    /**
+     * @brief Create an invisible window to hold an OpenGL context.
+     */
+    void CreateGLFW()
+    {
+        if (!glfwInit())
+            throw std::runtime_error("glfwInit failed");
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+        // Create the window [1x1] and invisible
+        _window = glfwCreateWindow(1, 1, "Framebuffer", NULL, NULL);
+        if (_window == NULL)
+        {
+            glfwTerminate();
+            throw std::runtime_error("Failed to create GLFW window");
+        }
+
+        glfwMakeContextCurrent(_window);
+        _description = "GLFW hidden window";
+    }
+
+    /**
+     * @brief Create a context without any window system.
+     * Platforms are tried in order: Mesa surfaceless, first EGL device, default display.
+     */
+    void CreateEGL()
+    {
+        const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+        std::string platform = "default display";
+        if (getPlatformDisplay != nullptr && HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless"))
+        {
+            _display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            platform = "surfaceless";
+        }
+
+        if (_display == EGL_NO_DISPLAY && getPlatformDisplay != nullptr && HasExtension(clientExtensions, "EGL_EXT_platform_device"))
+        {
+            auto queryDevices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(eglGetProcAddress("eglQueryDevicesEXT"));
+            EGLDeviceEXT device;
+            EGLint count = 0;
+            if (queryDevices != nullptr && queryDevices(1, &device, &count) && count > 0)
+            {
+                _display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, device, nullptr);
+                platform = "device";
+            }
+        }
+
+        if (_display == EGL_NO_DISPLAY)
+        {
+            _display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+            platform = "default display";
+        }
+
+        EGLint major, minor;
+        if (_display == EGL_NO_DISPLAY || !eglInitialize(_display, &major, &minor))
+            throw std::runtime_error("eglInitialize failed");
+
+        if (!eglBindAPI(EGL_OPENGL_API))
+            throw std::runtime_error("eglBindAPI(EGL_OPENGL_API) failed");
+
+        // Without surfaceless support, render through a 1x1 pbuffer
+        const char *displayExtensions = eglQueryString(_display, EGL_EXTENSIONS);
+        const bool surfaceless = HasExtension(displayExtensions, "EGL_KHR_surfaceless_context");
+
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE};
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(_display, configAttributes, &config, 1, &configCount) || configCount == 0)
+            throw std::runtime_error("eglChooseConfig failed");
+
+        if (!surfaceless)
+        {
+            const EGLint pbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+            _surface = eglCreatePbufferSurface(_display, config, pbufferAttributes);
+            if (_surface == EGL_NO_SURFACE)
+                throw std::runtime_error("eglCreatePbufferSurface failed");
+            platform += " + pbuffer";
+        }
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE};
+        _context = eglCreateContext(_display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (_context == EGL_NO_CONTEXT)
+            throw std::runtime_error("eglCreateContext failed (OpenGL 4.3 core)");
+
+        if (!eglMakeCurrent(_display, _surface, _surface, _context))
+            throw std::runtime_error("eglMakeCurrent failed");
+
+        _description = "EGL " + platform + " (EGL " + std::to_string(major) + "." + std::to_string(minor) + ")";
+    }
+
+    void InitGLEW()
+    {
+        glewExperimental = GL_TRUE; // stops glew crashing on OSX :-/
+        GLenum status = glewInit();
+
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        // GLEW loads the GL entry points first, then fails on GLX when there is no X display (EGL contexts)
+        if (status == GLEW_ERROR_NO_GLX_DISPLAY && _window == nullptr)
+            status = GLEW_OK;
+#endif
+
+        if (status != GLEW_OK)
+            throw std::runtime_error("glewInit failed");
+    }
+
+    static bool HasExtension(const char *extensions, const char *name)
+    {
+        if (extensions == nullptr)
+            return false;
+
+        const size_t length = std::strlen(name);
+        for (const char *p = std::strstr(extensions, name); p != nullptr; p = std::strstr(p + length, name))
+            if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+                return true;
+        return false;
+    }
+
+private:
+    // GLFW
+    GLFWwindow *_window;
+
+    // EGL
+    EGLDisplay _display;
+    EGLSurface _surface;
+    EGLContext _context;
+
+    std::string _description;
+    double _creationMs;
+};
+
+#endif // GLContext_hpp
@@ -0,0 +1,696 @@
+#ifndef GpuFilterContext_hpp
+#define GpuFilterContext_hpp
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "AsyncReadback.hpp"
+#include "GL.hpp"
+#include "GpuTimer.hpp"
+#include "Kernel.hpp"
+#include "ProgramCache.hpp"
+#include "Shader.hpp"
+#include "ShaderCompute.hpp"
+#include "StorageBuffer.hpp"
+#include "FrameBuffer.hpp"
+#include "Quad.hpp"
+#include "Texture.hpp"
+
+/**
+ * Long-lived GPU filtering state.
+ *
+ * The programs are generated for the selected kernel and built once per kernel (on first use, programs
+ * come from the on-disk binary cache when possible), so switching kernels back and forth never recompiles.
+ * The programs of the maxKernels most recently selected kernels are kept, older ones are deleted (a daemon
+ * serving arbitrary kernels stays bounded) and come back from the on-disk cache when selected again.
+ * The quad is built once, the textures and the FrameBuffers
+ * are kept between calls and their storage is only re-specified when the frame size changes.
+ * Filtering a stream of same-sized frames therefore costs one glTexSubImage2D upload,
+ * one draw or dispatch and one readback per frame. The Submit* variants queue the readback
+ * in a ring of pixel pack buffers so it overlaps the next frame, and both paths alternate two input / output
+ * pairs so the upload of a frame or a tile does not wait for the draw or dispatch of the previous one.
+ *
+ * Separable kernels (rank 1, see Kernel::Separate()) run as a horizontal then a vertical pass of size taps
+ * each instead of size * size taps, through a float intermediate texture (GL_RGBA32F) so the first pass is
+ * not rounded to 8 bits.
+ *
+ * Images with a side larger than MaxTileSize() (GL_MAX_TEXTURE_SIZE unless lowered) are split into tiles
+ * overlapping by the kernel radius, each filtered like a frame of its own and stitched into the output:
+ * the result is the one of a single texture. The download of a tile is queued in a ring of pack buffers,
+ * so the upload of the next tile overlaps the filtering of the previous ones.
+ *
+ * FilterComputePacked() runs the compute shader on shader storage buffers holding the BGR bytes of the
+ * cv::Mat (see GenerateComputePackedShader()): no alpha channel is added on upload nor dropped on readback,
+ * and a quarter fewer bytes cross the bus. Images larger than a storage block are filtered in bands.
+ * SetPixelsPerThread() selects its kernel: one pixel per invocation from a shared memory tile, or strips of
+ * 4 / 8 pixels per invocation loaded as packed words (see GenerateComputeStripShader()).
+ *
+ * When Timer() is enabled, each frame is split into the phases build (first frame only), upload,
+ * kernel and readback, with their GPU and CPU times.
+ *
+ * @remark Must be created and destroyed while its GL context is current.
+ */
+class GpuFilterContext
+{
+public:
+    explicit GpuFilterContext(const Kernel &kernel = Kernel::Edge())
+        : _kernel(kernel), _programsOfKernel(nullptr), _kernelUses(0), _quadBuilt(false), _shaderFrame(0), _computeFrame(0), _pixelsPerThread(1), _maxStorageBytes(0), _maxTileSize(0), _maxTextureSize(0) {}
+
+    /**
+     * @brief Select the kernel applied by the next frames.
+     */
+    void SetKernel(const Kernel &kernel)
+    {
+        _kernel = kernel;
+        _programsOfKernel = nullptr;
+    }
+
+    const Kernel &GetKernel() const { return _kernel; }
+
+    /**
+     * @brief Apply the filter using the vertex and fragment shaders.
+     *
+     * @param input The image to filter (8-bit BGR).
+     * @param output The filtered image.
+     */
+    void FilterShader(const cv::Mat &input, cv::Mat &output)
+    {
+        if (std::max(input.cols, input.rows) > MaxTileSize())
+        {
+            FilterTiled(input, output, false);
+            return;
+        }
+
+        _timer.NextFrame();
+        RunShader(input);
+
+        // Get the output
+        _timer.Begin("readback");
+        ShaderOutput().ToMat(output);
+        _timer.End();
+    }
+
+    /**
+     * @brief Apply the filter using the compute shader.
+     *
+     * @param input The image to filter (8-bit BGR).
+     * @param output The filtered image.
+     */
+    void FilterComputeShader(const cv::Mat &input, cv::Mat &output)
+    {
+        if (std::max(input.cols, input.rows) > MaxTileSize())
+        {
+            FilterTiled(input, output, true);
+            return;
+        }
+
+        _timer.NextFrame();
+        RunComputeShader(input);
+
+        // Get the output and drop the alpha
+        _timer.Begin("readback");
+        ComputeOutput().ToMat(_outputRGBA, 4);
+        cv::cvtColor(_outputRGBA, output, cv::COLOR_RGBA2RGB);
+        _timer.End();
+    }
+
+    /**
+     * @brief Apply the filter using the compute shader on packed BGR8 storage buffers: the bytes of the
+     * image are uploaded and downloaded as they are, without color conversion.
+     *
+     * @param image The image to filter (8-bit BGR, any row stride).
+     * @param output The filtered image.
+     * @throw std::runtime_error If a row with the halo of the kernel does not fit a storage block.
+     */
+    void FilterComputePacked(const cv::Mat &image, cv::Mat &output)
+    {
+        CV_Assert(image.type() == CV_8UC3);
+
+        // In place, the halo of the next band reads rows the previous one downloaded: the output gets its own
+        // storage, the input keeps a header of its own (image may be output itself)
+        const cv::Mat input = image;
+        if (output.data == input.data)
+            output.release();
+
+        // Bands of rows, with a halo of the kernel radius, when the image exceeds a storage block
+        const int radius = _kernel.Radius();
+        const GLsizeiptr pitch = PackedPitch(input.cols);
+        const int bandRows = static_cast<int>(std::min<GLint64>(MaxStorageBytes() / pitch, input.rows + 2 * radius)) - 2 * radius;
+        if (bandRows < 1)
+            throw std::runtime_error("Kernel " + _kernel.name + " is too large for storage blocks of " + std::to_string(MaxStorageBytes()) + " bytes");
+
+        output.create(input.rows, input.cols, CV_8UC3);
+
+        _timer.NextFrame();
+        for (int y = 0; y < input.rows; y += bandRows)
+        {
+            const int top = std::max(0, y - radius);
+            const int bottom = std::min(input.rows, y + bandRows + radius);
+            RunComputePacked(input.rowRange(top, bottom));
+
+            // Straight into the output rows, the halo rows are skipped
+            _timer.Begin("readback");
+            cv::Mat rows = output.rowRange(y, std::min(input.rows, y + bandRows));
+            _packedOutput.Download(rows, y - top, pitch);
+            _timer.End();
+        }
+    }
+
+    /**
+     * @brief Select the output pixels per invocation of FilterComputePacked(): 1 (shared memory tile),
+     * 4 or 8 (strips in registers). The best value depends on the GPU, see the benchmark.
+     *
+     * @throw std::runtime_error If the value is not 1, 4 or 8.
+     */
+    void SetPixelsPerThread(int pixels)
+    {
+        if (pixels != 1 && pixels != 4 && pixels != 8)
+            throw std::runtime_error("Invalid pixels per thread " + std::to_string(pixels) + " (1, 4 or 8)");
+        _pixelsPerThread = pixels;
+    }
+
+    int PixelsPerThread() const { return _pixelsPerThread; }
+
+    /**
+     * @brief Queue the fragment shader filter of a frame, the result is downloaded asynchronously.
+     * Collect it in submission order from Readback().
+     *
+     * @param input The image to filter (8-bit BGR).
+     * @param result If set, the future resolved with the filtered image.
+     * @return The ticket of the download.
+     * @throw std::runtime_error If the image exceeds the largest texture (FilterShader() tiles it).
+     */
+    uint64_t SubmitShader(const cv::Mat &input, std::future<cv::Mat> *result = nullptr)
+    {
+        CheckTextureSize(input.cols, input.rows);
+        _timer.NextFrame();
+        RunShader(input);
+
+        _timer.Begin("readback");
+        const uint64_t ticket = _readback.Enqueue(ShaderOutput(), 3, result);
+        _timer.End();
+        return ticket;
+    }
+
+    /**
+     * @brief Queue the compute shader filter of a frame, the result is downloaded asynchronously
+     * (directly as BGR, the alpha is dropped by the download). Collect it in submission order from Readback().
+     *
+     * @param input The image to filter (8-bit BGR).
+     * @param result If set, the future resolved with the filtered image.
+     * @return The ticket of the download.
+     * @throw std::runtime_error If the image exceeds the largest texture (FilterComputeShader() tiles it).
+     */
+    uint64_t SubmitComputeShader(const cv::Mat &input, std::future<cv::Mat> *result = nullptr)
+    {
+        CheckTextureSize(input.cols, input.rows);
+        _timer.NextFrame();
+        RunComputeShader(input);
+
+        _timer.Begin("readback");
+        const uint64_t ticket = _readback.Enqueue(ComputeOutput(), 3, result);
+        _timer.End();
+        return ticket;
+    }
+
+    /**
+     * @brief Run the compute shader between two RGBA8 textures of the same size.
+     * The output is ready for texture downloads (glGetTexImage) when this returns.
+     *
+     * @param input The texture to filter.
+     * @param output The filtered texture.
+     * @throw std::runtime_error If the textures exceed the largest texture (the intermediate one of separable kernels).
+     */
+    void DispatchCompute(const Texture &input, const Texture &output)
+    {
+        CheckTextureSize(input.Width(), input.Height());
+        BuildCompute();
+
+        // Run, one workgroup per tile rounded up to cover the borders
+        const GLuint groupsX = (input.Width() + computeTileSize - 1) / computeTileSize;
+        const GLuint groupsY = (input.Height() + computeTileSize - 1) / computeTileSize;
+
+        if (_programsOfKernel->computeVertical != nullptr)
+        {
+            // Horizontal pass into the float intermediate, the vertical pass reads it once written
+            _computeIntermediate.Allocate(input.Width(), input.Height(), GL_RGBA32F);
+            _programsOfKernel->compute->Use();
+            glBindImageTexture(0, input.ID(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA8);
+            glBindImageTexture(1, _computeIntermediate.ID(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+            glDispatchCompute(groupsX, groupsY, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+            _programsOfKernel->computeVertical->Use();
+            glBindImageTexture(0, _computeIntermediate.ID(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+        }
+        else
+        {
+            _programsOfKernel->compute->Use();
+            glBindImageTexture(0, input.ID(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA8);
+        }
+
+        glBindImageTexture(1, output.ID(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        glDispatchCompute(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    }
+
+    /**
+     * @brief Lower the largest tile side of FilterShader() and FilterComputeShader(), to bound the GPU memory
+     * of a frame (about 16 bytes per pixel of a tile with the intermediate textures).
+     *
+     * @param size The largest side, 0 to only split beyond GL_MAX_TEXTURE_SIZE.
+     */
+    void SetMaxTileSize(int size) { _maxTileSize = size; }
+
+    /**
+     * @brief The largest tile side: GL_MAX_TEXTURE_SIZE, or the lower SetMaxTileSize() value.
+     */
+    int MaxTileSize()
+    {
+        return _maxTileSize > 0 ? std::min(_maxTileSize, MaxTextureSize()) : MaxTextureSize();
+    }
+
+    /**
+     * @brief The largest texture side (GL_MAX_TEXTURE_SIZE).
+     */
+    int MaxTextureSize()
+    {
+        if (_maxTextureSize == 0)
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &_maxTextureSize);
+        return static_cast<int>(_maxTextureSize);
+    }
+
+    /**
+     * @brief The ring holding the downloads queued by SubmitShader() and SubmitComputeShader().
+     */
+    AsyncReadback &Readback() { return _readback; }
+
+    /**
+     * @brief The on-disk cache the programs are loaded from.
+     */
+    ProgramCache &Programs() { return _programs; }
+
+    /**
+     * @brief The per-phase timing of the frames (disabled by default).
+     */
+    GpuTimer &Timer() { return _timer; }
+
+private:
+    /**
+     * @brief The paths filtering the image in one texture, without tiling, need it to fit.
+     *
+     * @throw std::runtime_error If a side exceeds the largest texture.
+     */
+    void CheckTextureSize(int width, int height)
+    {
+        if (std::max(width, height) > MaxTextureSize())
+            throw std::runtime_error("Image of " + std::to_string(width) + "x" + std::to_string(height) + " larger than the textures of "
+                                     + std::to_string(MaxTextureSize()) + " pixels per side (FilterShader() and FilterComputeShader() tile it)");
+    }
+
+    /**
+     * @brief Filter an image larger than a texture, tile by tile.
+     *
+     * The tiles cover the image without overlap and are uploaded with a halo of the kernel radius
+     * (clamped to the image), so every output pixel sees the same neighbours as in a single texture.
+     * At most two tiles are in flight: the oldest one is stitched while the next one is uploaded.
+     *
+     * @param image The image to filter (8-bit BGR).
+     * @param output The filtered image.
+     * @param compute Use the compute shader instead of the fragment shader.
+     * @throw std::runtime_error If the kernel does not fit in a tile.
+     */
+    void FilterTiled(const cv::Mat &image, cv::Mat &output, bool compute)
+    {
+        const int radius = _kernel.Radius();
+        const int step = MaxTileSize() - 2 * radius;
+        if (step < 1)
+            throw std::runtime_error("Kernel " + _kernel.name + " is too large for tiles of " + std::to_string(MaxTileSize()) + " pixels");
+
+        // In place, the halos of the next tiles read pixels of the stitched ones: the output gets its own
+        // storage, the input keeps a header of its own (image may be output itself)
+        const cv::Mat input = image;
+        if (output.data == input.data)
+            output.release();
+        output.create(input.rows, input.cols, CV_8UC3);
+
+        // The tiles in flight: the output pixels and where they are in the downloaded tile
+        struct PendingTile
+        {
+            cv::Rect inner;
+            cv::Point offset;
+        };
+        std::deque<PendingTile> pending;
+
+        auto stitch = [&]()
+        {
+            cv::Mat mapped;
+            _tileReadback.Acquire(mapped);
+            const PendingTile &tile = pending.front();
+            mapped(cv::Rect(tile.offset.x, tile.offset.y, tile.inner.width, tile.inner.height)).copyTo(output(tile.inner));
+            _tileReadback.Release();
+            pending.pop_front();
+        };
+
+        _timer.NextFrame();
+        for (int y = 0; y < input.rows; y += step)
+        {
+            for (int x = 0; x < input.cols; x += step)
+            {
+                const cv::Rect inner(x, y, std::min(step, input.cols - x), std::min(step, input.rows - y));
+                const int left = std::max(0, x - radius);
+                const int top = std::max(0, y - radius);
+                const int right = std::min(input.cols, inner.x + inner.width + radius);
+                const int bottom = std::min(input.rows, inner.y + inner.height + radius);
+                const cv::Mat region = input(cv::Rect(left, top, right - left, bottom - top));
+
+                if (compute)
+                    RunComputeShader(region);
+                else
+                    RunShader(region);
+
+                _timer.Begin("readback");
+                _tileReadback.Enqueue(compute ? ComputeOutput() : ShaderOutput(), 3);
+                glFlush();
+                pending.push_back({inner, cv::Point(x - left, y - top)});
+                if (_tileReadback.Pending() > 1)
+                    stitch();
+                _timer.End();
+            }
+        }
+
+        _timer.Begin("readback");
+        while (!pending.empty())
+            stitch();
+        _timer.End();
+    }
+
+    /**
+     * @brief Upload the input and draw the quad into the FrameBuffer.
+     */
+    void RunShader(const cv::Mat &input)
+    {
+        Build();
+
+        const int width = input.cols;
+        const int height = input.rows;
+
+        // Upload the input and size the FrameBuffer (no-op allocations for same-sized frames), into the other
+        // pair than the previous frame, whose draw and download may still be running
+        _timer.Begin("upload");
+        _shaderFrame = (_shaderFrame + 1) % pairs;
+        Texture &inputTexture = _inputTextures[_shaderFrame];
+        FrameBuffer &fbo = _fbos[_shaderFrame];
+        inputTexture.Upload(input);
+        fbo.Allocate(width, height);
+        if (_programsOfKernel->shaderVertical != nullptr)
+            _fboIntermediate.Allocate(width, height, GL_RGBA32F);
+        fbo.Bind();
+        glViewport(0, 0, width, height);
+
+        // Horizontal pass of a separable kernel into the float FrameBuffer
+        _timer.Begin("kernel");
+        const Texture *source = &inputTexture;
+        if (_programsOfKernel->shaderVertical != nullptr)
+        {
+            _fboIntermediate.Bind();
+            Shader &horizontal = *_programsOfKernel->shader;
+            horizontal.Use();
+            horizontal.SetTexture("inputTexture", inputTexture);
+            _quad.Draw();
+
+            fbo.Bind();
+            source = &_fboIntermediate.Color_0();
+        }
+
+        // Set Shader input
+        Shader &shader = _programsOfKernel->shaderVertical != nullptr ? *_programsOfKernel->shaderVertical : *_programsOfKernel->shader;
+        shader.Use();
+        shader.SetTexture("inputTexture", *source);
+
+        // Draw
+        _quad.Draw();
+        fbo.UnBind();
+        _timer.End();
+    }
+
+    /**
+     * @brief The output texture of the last RunShader().
+     */
+    Texture &ShaderOutput() { return _fbos[_shaderFrame].Color_0(); }
+
+    /**
+     * @brief The output texture of the last RunComputeShader().
+     */
+    Texture &ComputeOutput() { return _computeOutputs[_computeFrame]; }
+
+    /**
+     * @brief Upload the input and dispatch the compute shader into the output texture.
+     */
+    void RunComputeShader(const cv::Mat &input)
+    {
+        BuildCompute();
+
+        const int width = input.cols;
+        const int height = input.rows;
+
+        // Add an alpha channel to the input (image load/store needs a 4 components format)
+        _timer.Begin("upload");
+        // Into the other pair than the previous frame, whose dispatch and download may still be running
+        _computeFrame = (_computeFrame + 1) % pairs;
+        cv::cvtColor(input, _inputRGBA, cv::COLOR_RGB2RGBA);
+        _computeInputs[_computeFrame].Upload(_inputRGBA);
+        ComputeOutput().Allocate(width, height, GL_RGBA8);
+
+        _timer.Begin("kernel");
+        DispatchCompute(_computeInputs[_computeFrame], ComputeOutput());
+        _timer.End();
+    }
+
+    /**
+     * @brief Upload the input bytes and dispatch the packed compute shader into the output buffer.
+     * The output buffer is ready to be mapped when this returns.
+     */
+    void RunComputePacked(const cv::Mat &input)
+    {
+        Build();
+
+        // Built on first use only, most runs never take this path
+        std::unique_ptr<ShaderCompute> &program = _programsOfKernel->computePacked[_pixelsPerThread];
+        if (program == nullptr)
+        {
+            _timer.Begin("build");
+            program = std::make_unique<ShaderCompute>(_pixelsPerThread == 1 ? GenerateComputePackedShader(_kernel)
+                                                                            : GenerateComputeStripShader(_kernel, _pixelsPerThread));
+            program->Build(&_programs);
+        }
+
+        const int width = input.cols;
+        const int height = input.rows;
+        const GLsizeiptr pitch = PackedPitch(width);
+
+        _timer.Begin("upload");
+        _packedInput.Upload(input, pitch);
+        _packedOutput.Allocate(pitch * height, GL_STREAM_READ);
+
+        _timer.Begin("kernel");
+        program->Use();
+        // Locations fixed by the generated source
+        glUniform2i(0, width, height);
+        glUniform1i(1, static_cast<GLint>(pitch));
+        glUniform1i(2, static_cast<GLint>(pitch));
+        _packedInput.BindBase(0);
+        _packedOutput.BindBase(1);
+        const int tileWidth = computeTileSize * _pixelsPerThread;
+        glDispatchCompute((width + tileWidth - 1) / tileWidth, (height + computeTileSize - 1) / computeTileSize, 1);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        _timer.End();
+    }
+
+    /**
+     * @brief The bytes per row of the packed buffers: the BGR bytes rounded up to whole words, so the words
+     * written by neighbouring workgroups never overlap and the strips load aligned words.
+     */
+    static GLsizeiptr PackedPitch(int width)
+    {
+        return StorageBuffer::AlignedSize(static_cast<GLsizeiptr>(width) * 3);
+    }
+
+    /**
+     * @brief The largest storage block a shader may access (GL_MAX_SHADER_STORAGE_BLOCK_SIZE).
+     */
+    GLint64 MaxStorageBytes()
+    {
+        if (_maxStorageBytes == 0)
+            glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &_maxStorageBytes);
+        return _maxStorageBytes;
+    }
+
+    /**
+     * @brief Build the fragment programs of the kernel (once per kernel) and the quad (once).
+     *
+     * The sources are generated and the programs built before the kernel gets an entry, so a kernel the
+     * shaders cannot take throws every time instead of leaving half-built programs behind.
+     */
+    void Build()
+    {
+        if (_programsOfKernel != nullptr)
+            return;
+
+        _timer.Begin("build");
+        if (!_quadBuilt)
+        {
+            _quad.Build();
+            _quadBuilt = true;
+        }
+
+        const std::string key = _kernel.Key();
+        auto found = _kernelPrograms.find(key);
+        if (found == _kernelPrograms.end())
+        {
+            if (_kernelPrograms.size() >= maxKernels)
+                EvictKernel();
+
+            KernelPrograms programs;
+            try
+            {
+                const std::vector<std::string> passes = GenerateConvolutionPasses(_kernel);
+                programs.shader = std::make_unique<Shader>(vertexShaderSource, passes[0]);
+                programs.shader->Build(&_programs);
+                if (passes.size() > 1)
+                {
+                    programs.shaderVertical = std::make_unique<Shader>(vertexShaderSource, passes[1]);
+                    programs.shaderVertical->Build(&_programs);
+                }
+            }
+            catch (...)
+            {
+                _timer.End();
+                throw;
+            }
+            found = _kernelPrograms.emplace(key, std::move(programs)).first;
+        }
+        found->second.lastUse = ++_kernelUses;
+        _programsOfKernel = &found->second;
+        _timer.End();
+    }
+
+    /**
+     * @brief Delete the programs of the least recently selected kernel (none is current while building).
+     */
+    void EvictKernel()
+    {
+        auto oldest = _kernelPrograms.begin();
+        for (auto it = _kernelPrograms.begin(); it != _kernelPrograms.end(); ++it)
+            if (it->second.lastUse < oldest->second.lastUse)
+                oldest = it;
+        _kernelPrograms.erase(oldest);
+    }
+
+    /**
+     * @brief Build the compute programs of the kernel on first use, like the packed ones: the fragment path
+     * keeps working for kernels too large for the compute shader tile.
+     *
+     * @throw std::runtime_error If the kernel does not fit the compute shader tile.
+     */
+    void BuildCompute()
+    {
+        Build();
+        KernelPrograms &programs = *_programsOfKernel;
+        if (programs.compute != nullptr)
+            return;
+
+        // Generated first (may throw), assigned once built
+        std::unique_ptr<ShaderCompute> compute, computeVertical;
+        std::vector<float> column, row;
+        if (_kernel.IsSeparable(column, row))
+        {
+            const int size = _kernel.size;
+            compute = std::make_unique<ShaderCompute>(GenerateComputeShader(_kernel.name + " horizontal", size, 1, row, 1.0f, 0.0f, "rgba8", "rgba32f"));
+            computeVertical = std::make_unique<ShaderCompute>(GenerateComputeShader(_kernel.name + " vertical", 1, size, column, _kernel.Scale(), _kernel.bias, "rgba32f", "rgba8"));
+        }
+        else
+            compute = std::make_unique<ShaderCompute>(GenerateComputeShader(_kernel));
+
+        _timer.Begin("build");
+        if (computeVertical != nullptr)
+            computeVertical->Build(&_programs);
+        compute->Build(&_programs);
+        _timer.End();
+
+        programs.computeVertical = std::move(computeVertical);
+        programs.compute = std::move(compute);
+    }
+
+private:
+    struct KernelPrograms
+    {
+        // The whole kernel, or the horizontal pass of a separable kernel (compute: built on first use)
+        std::unique_ptr<Shader> shader;
+        std::unique_ptr<ShaderCompute> compute;
+        // The vertical pass of a separable kernel (null otherwise)
+        std::unique_ptr<Shader> shaderVertical;
+        std::unique_ptr<ShaderCompute> computeVertical;
+        // The packed BGR8 storage buffer variants by pixels per invocation (built on first use)
+        std::map<int, std::unique_ptr<ShaderCompute>> computePacked;
+        // When the kernel was last selected (_kernelUses)
+        uint64_t lastUse = 0;
+    };
+
+    Kernel _kernel;
+    ProgramCache _programs;
+
+    // Generated programs by kernel key (maxKernels at most), the ones of the current kernel, kernel selections so far
+    static const size_t maxKernels = 16;
+    std::map<std::string, KernelPrograms> _kernelPrograms;
+    KernelPrograms *_programsOfKernel;
+    uint64_t _kernelUses;
+
+    // Input / output pairs used in turn by the frames and the tiles of both paths
+    static const int pairs = 2;
+
+    // Vertex / fragment path: the pairs, the current one
+    bool _quadBuilt;
+    Quad _quad;
+    std::array<Texture, pairs> _inputTextures;
+    std::array<FrameBuffer, pairs> _fbos;
+    int _shaderFrame;
+    FrameBuffer _fboIntermediate;
+
+    // Compute path: the pairs, the current one
+    std::array<Texture, pairs> _computeInputs;
+    std::array<Texture, pairs> _computeOutputs;
+    int _computeFrame;
+    Texture _computeIntermediate;
+
+    // Packed BGR8 compute path, output pixels per invocation, largest storage block
+    int _pixelsPerThread;
+    StorageBuffer _packedInput;
+    StorageBuffer _packedOutput;
+    GLint64 _maxStorageBytes;
+
+    // Host side RGBA staging, reused between frames
+    cv::Mat _inputRGBA;
+    cv::Mat _outputRGBA;
+
+    // Asynchronous downloads
+    AsyncReadback _readback;
+
+    // Tiles larger than a texture: downloads of the tiles in flight, largest tile side
+    AsyncReadback _tileReadback;
+    int _maxTileSize;
+    GLint _maxTextureSize;
+
+    // Per-phase timing
+    GpuTimer _timer;
+};
+
+#endif // GpuFilterContext_hpp
@@ -0,0 +1,283 @@
+#ifndef GpuFilterGraph_hpp
+#define GpuFilterGraph_hpp
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "FilterGraph.hpp"
+#include "FrameBuffer.hpp"
+#include "GL.hpp"
+#include "ProgramCache.hpp"
+#include "Quad.hpp"
+#include "Shader.hpp"
+#include "Texture.hpp"
+
+/**
+ * @brief Generate the fragment shader of a threshold node: 1.0 where the value is >= level / 255, else 0.0.
+ */
+inline std::string GenerateThresholdShader(int level)
+{
+    std::ostringstream source;
+    source << R"(
+    #version 430 core
+    out vec3 FragColor;
+    in vec2 TexCoords;
+
+    uniform sampler2D inputTexture;
+
+    // Threshold )" << level << R"(
+    void main()
+    {
+        vec3 value = texelFetch(inputTexture, ivec2(gl_FragCoord.xy), 0).rgb * 255.0;
+        FragColor = step(vec3()" << GlslFloat(level - 0.5f) << R"(), value);
+    }
+)";
+    return source.str();
+}
+
+/**
+ * @brief Generate the fragment shader of a blend node: weightA * a + weightB * b + bias.
+ */
+inline std::string GenerateBlendShader(float weightA, float weightB, float bias)
+{
+    std::ostringstream source;
+    source << R"(
+    #version 430 core
+    out vec3 FragColor;
+    in vec2 TexCoords;
+
+    uniform sampler2D inputTexture;
+    uniform sampler2D secondTexture;
+
+    void main()
+    {
+        ivec2 pos = ivec2(gl_FragCoord.xy);
+        FragColor = texelFetch(inputTexture, pos, 0).rgb * )"
+           << GlslFloat(weightA) << " + texelFetch(secondTexture, pos, 0).rgb * " << GlslFloat(weightB) << " + vec3("
+           << GlslFloat(bias / 255.0f) << R"();
+    }
+)";
+    return source.str();
+}
+
+/**
+ * Runs a FilterGraph on the GPU with the fragment shaders: the input is uploaded once, every node draws the
+ * quad into a FrameBuffer reading the textures of its inputs, and only the outputs are read back.
+ *
+ * The FrameBuffers come from a pool and go back to it after the last reader of their node, so a chain
+ * ping-pongs between two of them whatever its length. Separable kernels run their horizontal pass into a
+ * float FrameBuffer shared by the nodes. The pool, the programs (generated per node, built once per source
+ * and cached on disk) and the input texture are kept between the calls.
+ *
+ * @remark Must be created and destroyed while its GL context is current.
+ */
+class GpuFilterGraph
+{
+public:
+    GpuFilterGraph() : _quadBuilt(false), _maxTextureSize(0) {}
+
+    /**
+     * @brief Run the graph.
+     *
+     * @param graph The graph.
+     * @param input The image of the input node (8-bit BGR).
+     * @param outputs The images of the outputs of the graph, in order.
+     * @throw std::runtime_error If the graph has no output or the image exceeds the largest texture.
+     */
+    void Run(const FilterGraph &graph, const cv::Mat &input, std::vector<cv::Mat> &outputs)
+    {
+        CV_Assert(input.type() == CV_8UC3);
+        if (graph.Outputs().empty())
+            throw std::runtime_error("The filter graph has no output");
+        if (std::max(input.cols, input.rows) > MaxTextureSize())
+            throw std::runtime_error("The filter graph runs on images of " + std::to_string(MaxTextureSize()) + " pixels per side at most");
+
+        Build();
+
+        const std::vector<FilterNode> &nodes = graph.Nodes();
+        const std::vector<bool> live = graph.Live();
+        const std::vector<int> lastUse = graph.LastUse();
+        std::vector<bool> sink(nodes.size(), false);
+        for (int output : graph.Outputs())
+            sink[output] = true;
+
+        const int width = input.cols;
+        const int height = input.rows;
+        _input.Upload(input);
+        glViewport(0, 0, width, height);
+
+        // FrameBuffer of each node in the pool (-1: none)
+        std::vector<int> targets(nodes.size(), -1);
+        auto texture = [&](int node) -> const Texture &
+        { return node == graph.Input() ? _input : _pool[targets[node]]->Color_0(); };
+
+        for (size_t n = 1; n < nodes.size(); ++n)
+        {
+            if (!live[n])
+                continue;
+
+            const FilterNode &node = nodes[n];
+            NodePrograms &programs = ProgramsOf(node);
+            const Texture *source = &texture(node.inputs[0]);
+
+            // Horizontal pass of a separable kernel into the float FrameBuffer
+            if (programs.vertical != nullptr)
+            {
+                _intermediate.Allocate(width, height, GL_RGBA32F);
+                _intermediate.Bind();
+                programs.shader->Use();
+                programs.shader->SetTexture("inputTexture", *source);
+                _quad.Draw();
+                source = &_intermediate.Color_0();
+            }
+
+            const int target = Acquire(width, height);
+            _pool[target]->Bind();
+            Shader &shader = programs.vertical != nullptr ? *programs.vertical : *programs.shader;
+            shader.Use();
+            shader.SetTexture("inputTexture", *source);
+            if (node.type == FilterNode::Type::Blend)
+                shader.SetTexture("secondTexture", texture(node.inputs[1]), 1);
+            _quad.Draw();
+            targets[n] = target;
+
+            // The inputs read for the last time go back to the pool, the outputs wait for the readback
+            for (int i : node.inputs)
+                if (lastUse[i] == static_cast<int>(n) && !sink[i] && targets[i] >= 0)
+                {
+                    _free.push_back(targets[i]);
+                    targets[i] = -1;
+                }
+        }
+        _intermediate.UnBind();
+        glActiveTexture(GL_TEXTURE0);
+
+        outputs.resize(graph.Outputs().size());
+        for (size_t o = 0; o < outputs.size(); ++o)
+        {
+            const int node = graph.Outputs()[o];
+            if (node == graph.Input())
+                input.copyTo(outputs[o]);
+            else
+                _pool[targets[node]]->Color_0().ToMat(outputs[o]);
+        }
+
+        for (size_t n = 0; n < nodes.size(); ++n)
+            if (targets[n] >= 0)
+                _free.push_back(targets[n]);
+    }
+
+    /**
+     * @brief The FrameBuffers allocated so far: the most images of the graphs alive at once.
+     */
+    int Targets() const { return static_cast<int>(_pool.size()); }
+
+    ProgramCache &Programs() { return _programs; }
+
+private:
+    struct NodePrograms
+    {
+        // The whole pass, or the horizontal pass of a separable kernel
+        std::unique_ptr<Shader> shader;
+        // The vertical pass of a separable kernel (null otherwise)
+        std::unique_ptr<Shader> vertical;
+    };
+
+    void Build()
+    {
+        if (_quadBuilt)
+            return;
+        _quad.Build();
+        _quadBuilt = true;
+    }
+
+    GLint MaxTextureSize()
+    {
+        if (_maxTextureSize == 0)
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &_maxTextureSize);
+        return _maxTextureSize;
+    }
+
+    /**
+     * @brief A FrameBuffer of the pool sized for the image, a new one when all are in use.
+     */
+    int Acquire(int width, int height)
+    {
+        int target;
+        if (_free.empty())
+        {
+            _pool.push_back(std::make_unique<FrameBuffer>());
+            target = static_cast<int>(_pool.size()) - 1;
+        }
+        else
+        {
+            target = _free.back();
+            _free.pop_back();
+        }
+        _pool[target]->Allocate(width, height);
+        return target;
+    }
+
+    /**
+     * @brief The programs of a node, generated and built on first use.
+     */
+    NodePrograms &ProgramsOf(const FilterNode &node)
+    {
+        std::string source, verticalSource;
+        switch (node.type)
+        {
+        case FilterNode::Type::Convolution:
+        {
+            const std::vector<std::string> passes = GenerateConvolutionPasses(node.kernel);
+            source = passes[0];
+            if (passes.size() > 1)
+                verticalSource = passes[1];
+            break;
+        }
+        case FilterNode::Type::Threshold:
+            source = GenerateThresholdShader(node.level);
+            break;
+        case FilterNode::Type::Blend:
+            source = GenerateBlendShader(node.weightA, node.weightB, node.bias);
+            break;
+        case FilterNode::Type::Input:
+            throw std::runtime_error("The input node has no program");
+        }
+
+        NodePrograms &programs = _nodePrograms[source + verticalSource];
+        if (programs.shader == nullptr)
+        {
+            programs.shader = std::make_unique<Shader>(vertexShaderSource, source);
+            programs.shader->Build(&_programs);
+            if (!verticalSource.empty())
+            {
+                programs.vertical = std::make_unique<Shader>(vertexShaderSource, verticalSource);
+                programs.vertical->Build(&_programs);
+            }
+        }
+        return programs;
+    }
+
+    ProgramCache _programs;
+
+    // Programs by fragment sources
+    std::map<std::string, NodePrograms> _nodePrograms;
+
+    bool _quadBuilt;
+    Quad _quad;
+    Texture _input;
+    FrameBuffer _intermediate;
+
+    // Pool of 8-bit FrameBuffers, the free ones
+    std::vector<std::unique_ptr<FrameBuffer>> _pool;
+    std::vector<int> _free;
+    GLint _maxTextureSize;
+};
+
+#endif // GpuFilterGraph_hpp
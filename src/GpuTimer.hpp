@@ -0,0 +1,249 @@
+#ifndef GpuTimer_hpp
+#define GpuTimer_hpp
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "GL.hpp"
+
+/**
+ * Accumulated time of a named phase.
+ */
+struct PhaseTiming
+{
+    std::string name;
+    int samples = 0;
+    // GPU time between the timestamps around the phase
+    double gpuNs = 0.0;
+    // Host time between Begin() and End() (submission, CPU conversions and synchronous waits)
+    double cpuNs = 0.0;
+};
+
+/**
+ * Per-phase GPU and CPU timing built on GL_TIMESTAMP queries.
+ *
+ * A phase is bracketed by two glQueryCounter() timestamps, so phases can follow each other freely
+ * (GL_TIME_ELAPSED queries cannot overlap). The queries of a frame are double-buffered: they are read
+ * back when their set is reused two frames later, by then the GPU is done with them and reading never
+ * stalls the pipeline (unless the GPU is more than a frame behind).
+ *
+ * Disabled timers issue no GL call.
+ *
+ * @remark Must be used from the thread owning the GL context.
+ */
+class GpuTimer
+{
+public:
+    GpuTimer() : _enabled(false), _frame(0), _open(-1), _frames(0) {}
+
+    ~GpuTimer()
+    {
+        for (FrameQueries &set : _sets)
+            if (!set.pool.empty())
+                glDeleteQueries(static_cast<GLsizei>(set.pool.size()), set.pool.data());
+    }
+
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    void SetEnabled(bool enabled)
+    {
+        if (_enabled && !enabled)
+            Collect();
+        _enabled = enabled;
+    }
+
+    bool Enabled() const { return _enabled; }
+
+    /**
+     * @brief Start a frame: collect the frame that used the same query set two frames ago.
+     */
+    void NextFrame()
+    {
+        if (!_enabled)
+            return;
+
+        End();
+        _frame = (_frame + 1) % _sets.size();
+        Gather(_sets[_frame]);
+    }
+
+    /**
+     * @brief Start a phase, the open phase (if any) ends here.
+     *
+     * @param phase The name of the phase.
+     */
+    void Begin(const std::string &phase)
+    {
+        if (!_enabled)
+            return;
+
+        End();
+
+        FrameQueries &set = _sets[_frame];
+        Record record;
+        record.phase = IndexOf(phase);
+        record.begin = Query(set);
+        record.end = Query(set);
+        glQueryCounter(record.begin, GL_TIMESTAMP);
+        record.cpuStart = std::chrono::steady_clock::now();
+        set.records.push_back(record);
+        _open = static_cast<int>(set.records.size()) - 1;
+    }
+
+    /**
+     * @brief End the open phase.
+     */
+    void End()
+    {
+        if (!_enabled || _open < 0)
+            return;
+
+        Record &record = _sets[_frame].records[_open];
+        record.cpuNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - record.cpuStart).count();
+        glQueryCounter(record.end, GL_TIMESTAMP);
+        _open = -1;
+    }
+
+    /**
+     * @brief Read back every pending query (blocking), the totals are then complete.
+     */
+    void Collect()
+    {
+        if (!_enabled)
+            return;
+
+        End();
+        for (size_t i = 1; i <= _sets.size(); ++i)
+            Gather(_sets[(_frame + i) % _sets.size()]);
+    }
+
+    /**
+     * @brief Drop the pending queries and the totals.
+     */
+    void Reset()
+    {
+        _open = -1;
+        for (FrameQueries &set : _sets)
+        {
+            set.records.clear();
+            set.used = 0;
+        }
+        _phases.clear();
+        _frames = 0;
+    }
+
+    /**
+     * @brief The totals per phase, in order of first appearance.
+     */
+    const std::vector<PhaseTiming> &Phases() const { return _phases; }
+
+    /**
+     * @brief The number of frames collected (frames with at least one phase).
+     */
+    int Frames() const { return _frames; }
+
+    /**
+     * @brief Print the average time per frame of each phase (ms): one "phase GPU CPU" line each, tab separated.
+     *
+     * @param out The stream.
+     * @param prefix The columns before the phase (e.g. "method\t"), a tab ends each of them.
+     */
+    void Print(std::ostream &out, const std::string &prefix = "") const
+    {
+        const std::ios_base::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+
+        out << std::fixed << std::setprecision(3);
+        const double frames = std::max(_frames, 1);
+        for (const PhaseTiming &phase : _phases)
+            out << prefix << phase.name << "\t" << phase.gpuNs * 1e-6 / frames << "\t" << phase.cpuNs * 1e-6 / frames << std::endl;
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+private:
+    struct Record
+    {
+        int phase = 0;
+        GLuint begin = 0;
+        GLuint end = 0;
+        std::chrono::steady_clock::time_point cpuStart;
+        double cpuNs = 0.0;
+    };
+
+    struct FrameQueries
+    {
+        std::vector<GLuint> pool;
+        size_t used = 0;
+        std::vector<Record> records;
+    };
+
+    int IndexOf(const std::string &phase)
+    {
+        for (size_t i = 0; i < _phases.size(); ++i)
+            if (_phases[i].name == phase)
+                return static_cast<int>(i);
+
+        PhaseTiming timing;
+        timing.name = phase;
+        _phases.push_back(timing);
+        return static_cast<int>(_phases.size()) - 1;
+    }
+
+    /**
+     * @brief The next free query of a set, the pool grows on demand and is kept between frames.
+     */
+    static GLuint Query(FrameQueries &set)
+    {
+        if (set.used == set.pool.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            set.pool.push_back(query);
+        }
+        return set.pool[set.used++];
+    }
+
+    /**
+     * @brief Add the results of a set to the totals and free it.
+     */
+    void Gather(FrameQueries &set)
+    {
+        if (set.records.empty())
+            return;
+
+        for (const Record &record : set.records)
+        {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(record.begin, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(record.end, GL_QUERY_RESULT, &end);
+
+            PhaseTiming &phase = _phases[record.phase];
+            phase.samples++;
+            phase.gpuNs += static_cast<double>(end - begin);
+            phase.cpuNs += record.cpuNs;
+        }
+
+        set.records.clear();
+        set.used = 0;
+        _frames++;
+    }
+
+private:
+    bool _enabled;
+    std::array<FrameQueries, 2> _sets;
+    size_t _frame;
+    int _open;
+
+    std::vector<PhaseTiming> _phases;
+    int _frames;
+};
+
+#endif // GpuTimer_hpp
@@ -0,0 +1,141 @@
+#ifndef HybridBackend_hpp
+#define HybridBackend_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "FilterBackend.hpp"
+#include "Kernel.hpp"
+
+/**
+ * Runs a CPU backend and a GPU backend at the same time on one image or one batch.
+ *
+ * An image is split in two row bands, the top one for the GPU and the bottom one for the CPU, each filtered
+ * with a halo of the kernel radius rows so the result does not depend on the split. The GPU band runs on
+ * the calling thread (the one holding the GL context), the CPU band on a helper thread which spreads it
+ * over the thread pool. The share of the GPU follows the throughput measured on each band (moving average)
+ * so both bands finish at the same time.
+ *
+ * A batch is not split: the calling thread (GPU) and the helper thread (CPU) take the next image of the
+ * batch whenever they are done with the previous one.
+ *
+ * @remark The rows of the CPU band keep the CPU borders (black border of the kernel radius).
+ */
+class HybridBackend : public IFilterBackend
+{
+public:
+    /**
+     * @param cpu The backend of the CPU band, safe to call from another thread (CPU, CPU_MP).
+     * @param gpu The backend of the GPU band, called from the calling thread only.
+     */
+    HybridBackend(IFilterBackend &cpu, IFilterBackend &gpu) : _cpu(cpu), _gpu(gpu), _gpuShare(0.5), _cpuRate(0.0), _gpuRate(0.0), _reportedShare(-1.0) {}
+
+    std::string Name() const override { return "Hybrid"; }
+
+    bool Composite() const override { return true; }
+
+    void Filter(const cv::Mat &image, cv::Mat &output, const Kernel &kernel) override
+    {
+        typedef std::chrono::steady_clock clock;
+
+        // In place, each band reads input rows around the split the other band writes: the output gets its
+        // own storage, the input keeps a header of its own (image may be output itself)
+        const cv::Mat input = image;
+        if (output.data == input.data)
+            output.release();
+
+        const int rows = input.rows;
+        const int radius = kernel.Radius();
+        const int split = std::clamp(static_cast<int>(std::lround(rows * _gpuShare)), 0, rows);
+        output.create(rows, input.cols, CV_8UC3);
+
+        // The CPU band is started first, the GPU band needs this thread
+        std::future<double> cpuDone;
+        if (split < rows)
+            cpuDone = std::async(std::launch::async, [&, split]()
+                                 {
+                const auto t0 = clock::now();
+                const int top = std::max(0, split - radius);
+                cv::Mat band;
+                _cpu.Filter(input.rowRange(top, rows), band, kernel);
+                band.rowRange(split - top, band.rows).copyTo(output.rowRange(split, rows));
+                return std::chrono::duration<double>(clock::now() - t0).count(); });
+
+        double gpuSeconds = 0.0;
+        if (split > 0)
+        {
+            const auto t0 = clock::now();
+            _gpu.Filter(input.rowRange(0, std::min(rows, split + radius)), _gpuBand, kernel);
+            _gpuBand.rowRange(0, split).copyTo(output.rowRange(0, split));
+            gpuSeconds = std::chrono::duration<double>(clock::now() - t0).count();
+        }
+
+        const double cpuSeconds = cpuDone.valid() ? cpuDone.get() : 0.0;
+        Balance(split, rows - split, gpuSeconds, cpuSeconds);
+    }
+
+    void FilterBatch(const std::vector<cv::Mat> &inputs, std::vector<cv::Mat> &outputs, const Kernel &kernel) override
+    {
+        outputs.resize(inputs.size());
+
+        std::atomic<size_t> next(0);
+        auto cpuDone = std::async(std::launch::async, [&]()
+                                  {
+            for (size_t i = next++; i < inputs.size(); i = next++)
+                _cpu.Filter(inputs[i], outputs[i], kernel); });
+
+        for (size_t i = next++; i < inputs.size(); i = next++)
+            _gpu.Filter(inputs[i], outputs[i], kernel);
+        cpuDone.get();
+    }
+
+    /**
+     * @brief The share of the rows of the next image given to the GPU.
+     */
+    double GpuShare() const { return _gpuShare; }
+
+private:
+    /**
+     * @brief Update the throughput of each side and move the split so both finish together.
+     * Both sides always keep a few percent of the rows, to keep measuring them.
+     */
+    void Balance(int gpuRows, int cpuRows, double gpuSeconds, double cpuSeconds)
+    {
+        const double weight = 0.5;
+        if (gpuRows > 0 && gpuSeconds > 0.0)
+            _gpuRate = _gpuRate > 0.0 ? weight * gpuRows / gpuSeconds + (1.0 - weight) * _gpuRate : gpuRows / gpuSeconds;
+        if (cpuRows > 0 && cpuSeconds > 0.0)
+            _cpuRate = _cpuRate > 0.0 ? weight * cpuRows / cpuSeconds + (1.0 - weight) * _cpuRate : cpuRows / cpuSeconds;
+        if (_gpuRate <= 0.0 || _cpuRate <= 0.0)
+            return;
+
+        _gpuShare = std::clamp(_gpuRate / (_gpuRate + _cpuRate), 0.05, 0.95);
+        if (std::abs(_gpuShare - _reportedShare) > 0.05)
+        {
+            std::cout << "[HybridBackend] GPU share : " << std::lround(_gpuShare * 100.0) << "% (" << _gpu.Name() << " + " << _cpu.Name() << ")" << std::endl;
+            _reportedShare = _gpuShare;
+        }
+    }
+
+private:
+    IFilterBackend &_cpu;
+    IFilterBackend &_gpu;
+
+    // Rows per second of each side, share of the GPU
+    double _gpuShare;
+    double _cpuRate;
+    double _gpuRate;
+    double _reportedShare;
+
+    // GPU band output, reused between calls
+    cv::Mat _gpuBand;
+};
+
+#endif // HybridBackend_hpp
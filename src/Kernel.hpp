@@ -0,0 +1,241 @@
+#ifndef Kernel_hpp
+#define Kernel_hpp
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Square convolution kernel shared by every backend.
+ *
+ * Each output channel is computed as
+ *    saturate(sum(weight * input) / divisor + bias)
+ * with the weights in row-major order, the first row applying to the row above the center
+ * (radius rows above for larger kernels). The input and the bias are in the [0, 255] range.
+ */
+struct Kernel
+{
+    std::string name;
+    int size = 0;
+    std::vector<float> weights;
+    float divisor = 1.0f;
+    float bias = 0.0f;
+
+    /**
+     * @brief Build a kernel, the weights and divisor are validated.
+     *
+     * @throw std::runtime_error If the size is not odd or does not match the weights, or a coefficient is invalid.
+     */
+    Kernel(const std::string &name, int size, const std::vector<float> &weights, float divisor = 1.0f, float bias = 0.0f)
+        : name(name), size(size), weights(weights), divisor(divisor), bias(bias)
+    {
+        if (size < 1 || size % 2 == 0)
+            throw std::runtime_error("Kernel " + name + ": the size must be odd, got " + std::to_string(size));
+        if (static_cast<int>(weights.size()) != size * size)
+            throw std::runtime_error("Kernel " + name + ": expected " + std::to_string(size * size) + " weights, got " + std::to_string(weights.size()));
+        if (divisor == 0.0f || !std::isfinite(divisor))
+            throw std::runtime_error("Kernel " + name + ": invalid divisor");
+        for (float w : weights)
+            if (!std::isfinite(w))
+                throw std::runtime_error("Kernel " + name + ": invalid weight");
+        if (!std::isfinite(bias))
+            throw std::runtime_error("Kernel " + name + ": invalid bias");
+    }
+
+    int Radius() const { return size / 2; }
+
+    float Weight(int kx, int ky) const { return weights[ky * size + kx]; }
+
+    /**
+     * @brief The factor applied to the weighted sum (1 / divisor).
+     */
+    float Scale() const { return 1.0f / divisor; }
+
+    /**
+     * @brief Rank-1 decomposition: weights[ky * size + kx] == column[ky] * row[kx].
+     *
+     * The factors are read through the largest weight (the pivot). The kernel is separable when every
+     * weight matches the outer product within 1e-6 of the pivot magnitude (box, binomial / gaussian, Sobel, ...).
+     *
+     * @param column Receives the column factor (size taps).
+     * @param row Receives the row factor (size taps).
+     * @return true if the kernel is separable.
+     */
+    bool Separate(std::vector<float> &column, std::vector<float> &row) const
+    {
+        int pivot = 0;
+        for (int t = 1; t < size * size; ++t)
+            if (std::abs(weights[t]) > std::abs(weights[pivot]))
+                pivot = t;
+
+        const int px = pivot % size;
+        const int py = pivot / size;
+        const double reference = weights[pivot];
+
+        column.resize(size);
+        row.resize(size);
+        for (int k = 0; k < size; ++k)
+        {
+            column[k] = Weight(px, k);
+            row[k] = reference != 0.0 ? static_cast<float>(Weight(k, py) / reference) : 0.0f;
+        }
+
+        const double tolerance = 1e-6 * std::abs(reference);
+        for (int ky = 0; ky < size; ++ky)
+            for (int kx = 0; kx < size; ++kx)
+                if (std::abs(Weight(kx, ky) - static_cast<double>(column[ky]) * row[kx]) > tolerance)
+                    return false;
+        return true;
+    }
+
+    /**
+     * @brief Whether the backends run the kernel as a horizontal and a vertical pass: larger than 1x1 and separable.
+     *
+     * @param column Receives the column factor when separable.
+     * @param row Receives the row factor when separable.
+     */
+    bool IsSeparable(std::vector<float> &column, std::vector<float> &row) const
+    {
+        return size > 1 && Separate(column, row);
+    }
+
+    bool IsSeparable() const
+    {
+        std::vector<float> column, row;
+        return IsSeparable(column, row);
+    }
+
+    /**
+     * @brief Text uniquely describing the coefficients (used to key generated programs).
+     */
+    std::string Key() const
+    {
+        std::ostringstream key;
+        key.precision(9);
+        key << size << ":";
+        for (float w : weights)
+            key << w << ",";
+        key << "/" << divisor << "+" << bias;
+        return key.str();
+    }
+
+    /**
+     * @brief Laplacian edge detection (sum = 0).
+     */
+    static Kernel Edge()
+    {
+        return Kernel("edge", 3, {1, 1, 1,
+                                  1, -8, 1,
+                                  1, 1, 1});
+    }
+
+    /**
+     * @brief Sharpen (sum = 1).
+     */
+    static Kernel Sharp()
+    {
+        return Kernel("sharp", 3, {-1, -1, -1,
+                                   -1, 9, -1,
+                                   -1, -1, -1});
+    }
+
+    /**
+     * @brief 5x5 binomial approximation of a gaussian blur.
+     */
+    static Kernel Gaussian5()
+    {
+        return Kernel("gaussian5", 5, {1, 4, 6, 4, 1,
+                                       4, 16, 24, 16, 4,
+                                       6, 24, 36, 24, 6,
+                                       4, 16, 24, 16, 4,
+                                       1, 4, 6, 4, 1},
+                      256.0f);
+    }
+
+    /**
+     * @brief Read a kernel from a text file.
+     *
+     * The file holds the size * size weights (row-major, any whitespace), optionally
+     * "divisor D" and "bias B" entries. The size is deduced from the number of weights,
+     * '#' starts a comment.
+     *
+     * @param path The file to read.
+     * @throw std::runtime_error If the file cannot be read or is invalid.
+     */
+    static Kernel Load(const std::string &path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            throw std::runtime_error("Cannot open kernel file " + path);
+
+        std::vector<float> weights;
+        float divisor = 1.0f, bias = 0.0f;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream tokens(line.substr(0, line.find('#')));
+            std::string token;
+            while (tokens >> token)
+            {
+                float *target = nullptr;
+                if (token == "divisor")
+                    target = &divisor;
+                else if (token == "bias")
+                    target = &bias;
+
+                if (target != nullptr && !(tokens >> token))
+                    throw std::runtime_error("Kernel file " + path + ": missing value after " + (target == &divisor ? "divisor" : "bias"));
+
+                char *end = nullptr;
+                const float value = std::strtof(token.c_str(), &end);
+                if (end == token.c_str() || *end != '\0')
+                    throw std::runtime_error("Kernel file " + path + ": invalid number " + token);
+
+                if (target != nullptr)
+                    *target = value;
+                else
+                    weights.push_back(value);
+            }
+        }
+
+        const int size = static_cast<int>(std::lround(std::sqrt(static_cast<double>(weights.size()))));
+        if (size * size != static_cast<int>(weights.size()))
+            throw std::runtime_error("Kernel file " + path + ": " + std::to_string(weights.size()) + " weights is not a square");
+
+        return Kernel(path, size, weights, divisor, bias);
+    }
+
+    /**
+     * @brief A kernel by preset name (edge, sharp, gaussian5) or from a file.
+     */
+    static Kernel FromName(const std::string &name)
+    {
+        if (name == "edge")
+            return Edge();
+        if (name == "sharp")
+            return Sharp();
+        if (name == "gaussian5")
+            return Gaussian5();
+        return Load(name);
+    }
+};
+
+/**
+ * @brief Format a float as a GLSL float literal (always with a dot or an exponent).
+ */
+inline std::string GlslFloat(float value)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", value);
+    std::string literal = text;
+    if (literal.find_first_of(".e") == std::string::npos)
+        literal += ".0";
+    return literal;
+}
+
+#endif // Kernel_hpp
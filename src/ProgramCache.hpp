@@ -0,0 +1,235 @@
+#ifndef ProgramCache_hpp
+#define ProgramCache_hpp
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "GL.hpp"
+
+/**
+ * On-disk cache of linked program binaries (ARB_get_program_binary).
+ *
+ * A program is keyed by a hash of its sources and defines and of the driver vendor / renderer / version
+ * strings, so a driver update never loads a stale binary. The driver may still reject a binary
+ * (glProgramBinary leaves the program unlinked): the entry is then dropped and the caller compiles from source.
+ *
+ * Location: $GL_COMPUTE_PROGRAM_CACHE, else $XDG_CACHE_HOME/gl-compute, else ~/.cache/gl-compute.
+ * Setting GL_COMPUTE_PROGRAM_CACHE to an empty string disables the cache.
+ *
+ * @remark Must be used while the GL context is current.
+ */
+class ProgramCache
+{
+public:
+    ProgramCache() : _enabled(false), _initialized(false), _hits(0), _misses(0), _rejected(0), _stored(0) {}
+
+    /**
+     * @brief Try to create a linked program from the cache.
+     *
+     * @param parts The sources and defines the program is built from.
+     * @param program Receives the program name on success.
+     * @return true on a hit, false if the program must be compiled (then Store() it).
+     */
+    bool Load(const std::vector<std::string> &parts, GLuint &program)
+    {
+        if (!Enabled())
+            return false;
+
+        const std::filesystem::path path = PathOf(parts);
+        std::ifstream file(path, std::ios::binary);
+        Header header;
+        if (!file || !file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != magic)
+        {
+            ++_misses;
+            return false;
+        }
+
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), header.length))
+        {
+            ++_misses;
+            return false;
+        }
+
+        program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE)
+        {
+            // Driver changed in a way the key does not capture, or corrupted entry
+            std::cout << "[ProgramCache] rejected : " << path.filename().string() << std::endl;
+            glDeleteProgram(program);
+            program = 0;
+            std::error_code error;
+            std::filesystem::remove(path, error);
+            ++_rejected;
+            ++_misses;
+            return false;
+        }
+
+        ++_hits;
+        return true;
+    }
+
+    /**
+     * @brief Tell the driver the binary of a program will be retrieved (call before linking).
+     */
+    void Prepare(GLuint program)
+    {
+        if (Enabled())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    /**
+     * @brief Save the binary of a freshly linked program.
+     *
+     * @param parts The sources and defines the program was built from.
+     * @param program The linked program.
+     */
+    void Store(const std::vector<std::string> &parts, GLuint program)
+    {
+        if (!Enabled())
+            return;
+
+        GLint linked = GL_FALSE, length = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (linked != GL_TRUE || length <= 0)
+            return;
+
+        Header header;
+        std::vector<char> binary(length);
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &header.format, binary.data());
+        header.length = static_cast<uint32_t>(written);
+
+        // Write then rename, concurrent processes never read a partial entry
+        const std::filesystem::path path = PathOf(parts);
+        std::filesystem::path temporary = path;
+        temporary += ".tmp" + std::to_string(getpid());
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(binary.data(), written);
+        file.close();
+
+        // A failed write (full disk, ...) leaves no partial file behind
+        std::error_code error;
+        if (file.fail())
+        {
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+            std::filesystem::remove(temporary, error);
+        else
+            ++_stored;
+    }
+
+    int Hits() const { return _hits; }
+    int Misses() const { return _misses; }
+
+    void PrintStats(std::ostream &out) const
+    {
+        out << "[ProgramCache] " << (_enabled ? _directory.string() : std::string("disabled"))
+            << " : " << _hits << " hits, " << _misses << " misses (" << _rejected << " rejected), "
+            << _stored << " stored" << std::endl;
+    }
+
+private:
+    struct Header
+    {
+        uint32_t magic = ProgramCache::magic;
+        GLenum format = 0;
+        uint32_t length = 0;
+    };
+
+    static constexpr uint32_t magic = 0x42504c47; // "GLPB"
+
+    /**
+     * @brief Resolve the directory and check the driver supports program binaries, once.
+     */
+    bool Enabled()
+    {
+        if (_initialized)
+            return _enabled;
+        _initialized = true;
+
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        if (formats == 0)
+            return false;
+
+        if (const char *dir = std::getenv("GL_COMPUTE_PROGRAM_CACHE"))
+            _directory = dir;
+        else if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0')
+            _directory = std::filesystem::path(xdg) / "gl-compute";
+        else if (const char *home = std::getenv("HOME"))
+            _directory = std::filesystem::path(home) / ".cache" / "gl-compute";
+
+        if (_directory.empty())
+            return false;
+
+        std::error_code error;
+        std::filesystem::create_directories(_directory, error);
+        _enabled = !error;
+
+        // The driver identification is part of every key
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const GLubyte *value = glGetString(name);
+            _driver += value != nullptr ? reinterpret_cast<const char *>(value) : "";
+            _driver += '\n';
+        }
+
+        return _enabled;
+    }
+
+    /**
+     * @brief FNV-1a 64 of the driver strings and of the length-prefixed parts.
+     */
+    std::filesystem::path PathOf(const std::vector<std::string> &parts) const
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        auto mix = [&hash](const std::string &text)
+        {
+            const std::string length = std::to_string(text.size()) + ':';
+            for (char c : length + text)
+            {
+                hash ^= static_cast<unsigned char>(c);
+                hash *= 0x100000001b3ull;
+            }
+        };
+
+        mix(_driver);
+        for (const std::string &part : parts)
+            mix(part);
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(hash));
+        return _directory / name;
+    }
+
+private:
+    bool _enabled;
+    bool _initialized;
+    std::filesystem::path _directory;
+    std::string _driver;
+
+    int _hits;
+    int _misses;
+    int _rejected;
+    int _stored;
+};
+
+#endif // ProgramCache_hpp
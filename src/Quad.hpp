@@ -1,7 +1,10 @@
+#ifndef Quad_hpp
+#define Quad_hpp
+
 #include "GL.hpp"
 
 // Quad vertices
-float quadVertices[] = {
+static const float quadVertices[] = {
     // Positions   // TexCoords
     -1.0f, 1.0f, 0.0f, 1.0f,
     -1.0f, -1.0f, 0.0f, 0.0f,
@@ -11,19 +14,60 @@ float quadVertices[] = {
     1.0f, -1.0f, 1.0f, 0.0f,
     1.0f, 1.0f, 1.0f, 1.0f};
 
-void BuildQuad(GLuint &VAO)
+/**
+ * Full screen quad (two triangles) owning its VAO and VBO.
+ */
+class Quad
 {
-    // Create VAO & VBO
-    GLuint VBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-}
+public:
+    Quad() : _VAO(0), _VBO(0) {}
+    ~Quad()
+    {
+        if (_VBO != 0)
+        {
+            glDeleteBuffers(1, &_VBO);
+            _VBO = 0;
+        }
+
+        if (_VAO != 0)
+        {
+            std::cout << "[Quad] Deleting : " << _VAO << std::endl;
+            glDeleteVertexArrays(1, &_VAO);
+            _VAO = 0;
+        }
+    }
+
+    void Build()
+    {
+        // Create VAO & VBO
+        glGenVertexArrays(1, &_VAO);
+        glGenBuffers(1, &_VBO);
+
+        glBindVertexArray(_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, _VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)(2 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        std::cout << "[Quad] Built : " << _VAO << std::endl;
+    }
+
+    void Draw()
+    {
+        glBindVertexArray(_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindVertexArray(0);
+    }
+
+private:
+    GLuint _VAO;
+    GLuint _VBO;
+};
+
+#endif // Quad_hpp
@@ -2,12 +2,17 @@
 #define Shader_hpp
 
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #include "GL.hpp"
+#include "Kernel.hpp"
+#include "ProgramCache.hpp"
 #include "Texture.hpp"
 
 // Vertex Shader
-const char *vertexShaderSource = R"(
+static const char *const vertexShaderSource = R"(
     #version 430 core
     layout (location = 0) in vec2 aPos;
     layout (location = 1) in vec2 aTexCoords;
@@ -21,65 +26,87 @@ const char *vertexShaderSource = R"(
     }
     )";
 
-// Fragment Shader
-const char *fragmentShaderSource = R"(
+/**
+ * @brief Generate the fragment shader of a convolution pass.
+ *
+ * Each fragment reads its texel neighbourhood with texelFetch (clamped to the borders). The taps are
+ * unrolled with the weights as literals, zero weights are skipped, so the compiler sees only constants.
+ *
+ * @param name The name of the kernel (comment only).
+ * @param sizeX The width of the pass (odd).
+ * @param sizeY The height of the pass (odd).
+ * @param weights The sizeX * sizeY weights in row-major order.
+ * @param scale The factor applied to the weighted sum.
+ * @param bias The value added after scaling, in [0, 255] units.
+ * @return The GLSL source.
+ */
+inline std::string GenerateFragmentShader(const std::string &name, int sizeX, int sizeY, const std::vector<float> &weights, float scale, float bias)
+{
+    std::ostringstream source;
+    source << R"(
     #version 430 core
     out vec3 FragColor;
     in vec2 TexCoords;
 
-    uniform float width;
-    uniform float height;
-
     uniform sampler2D inputTexture;
-    
+
+    // Kernel )" << name << " (" << sizeX << "x" << sizeY << R"()
     void main()
     {
-        vec2 dir = vec2(1.0 / width, 1.0 / height);  
-
-        vec2 offsets[9] = vec2[](
-            vec2(-dir.x,  dir.y), // top-left
-            vec2( 0.0f,    dir.y), // top-center
-            vec2( dir.x,  dir.y), // top-right
-            vec2(-dir.x,  0.0f),   // center-left
-            vec2( 0.0f,    0.0f),   // center-center
-            vec2( dir.x,  0.0f),   // center-right
-            vec2(-dir.x, -dir.y), // bottom-left
-            vec2( 0.0f,   -dir.y), // bottom-center
-            vec2( dir.x, -dir.y)  // bottom-right    
-        );
-
-        // Sharp
-        /*float kernel[9] = float[](
-            -1, -1, -1,
-            -1,  9, -1,
-            -1, -1, -1
-        );*/
-
-        // Edge (sum = 0 )
-        float kernel[9] = float[](
-            1,  1,  1,
-            1, -8,  1,
-            1,  1,  1
-        );
-    
-        // Sample the input texture
-        vec3 sampleTex[9];
-        for(int i = 0; i < 9; i++)
-            sampleTex[i] = vec3(texture(inputTexture, TexCoords.st + offsets[i]));
-
-        // Accumulate
-        vec3 col = vec3(0.0);
-        for(int i = 0; i < 9; i++)
-            col += sampleTex[i] * kernel[i];
-    
-        FragColor = col;
-    }
-    )";
+        ivec2 pos = ivec2(gl_FragCoord.xy);
+        ivec2 last = textureSize(inputTexture, 0) - 1;
+
+        vec3 sum = vec3(0.0);
+)";
+
+    for (int ky = 0; ky < sizeY; ++ky)
+        for (int kx = 0; kx < sizeX; ++kx)
+            if (weights[ky * sizeX + kx] != 0.0f)
+                source << "        sum += texelFetch(inputTexture, clamp(pos + ivec2(" << kx - sizeX / 2 << ", " << ky - sizeY / 2
+                       << "), ivec2(0), last), 0).rgb * " << GlslFloat(weights[ky * sizeX + kx]) << ";\n";
+
+    source << "\n        FragColor = sum";
+    if (scale != 1.0f)
+        source << " * " << GlslFloat(scale);
+    if (bias != 0.0f)
+        source << " + " << GlslFloat(bias / 255.0f);
+    source << ";\n    }\n";
+
+    return source.str();
+}
+
+/**
+ * @brief Generate the fragment shader applying all the taps of a kernel.
+ */
+inline std::string GenerateFragmentShader(const Kernel &kernel)
+{
+    return GenerateFragmentShader(kernel.name, kernel.size, kernel.size, kernel.weights, kernel.Scale(), kernel.bias);
+}
+
+/**
+ * @brief Generate the fragment shaders of the passes of a kernel, in order: the horizontal then the vertical
+ * pass of a separable kernel, else a single pass applying all the taps.
+ */
+inline std::vector<std::string> GenerateConvolutionPasses(const Kernel &kernel)
+{
+    std::vector<float> column, row;
+    if (!kernel.IsSeparable(column, row))
+        return {GenerateFragmentShader(kernel)};
+
+    // The horizontal pass keeps the raw sums, the vertical pass applies the scale and the bias
+    return {GenerateFragmentShader(kernel.name + " horizontal", kernel.size, 1, row, 1.0f, 0.0f),
+            GenerateFragmentShader(kernel.name + " vertical", 1, kernel.size, column, kernel.Scale(), kernel.bias)};
+}
 
 class Shader
 {
 public:
-    Shader() : _program(0), _vertexShader(0), _fragmentShader(0) {}
+    Shader(const std::string &vertexSource, const std::string &fragmentSource)
+        : _vertexSource(vertexSource), _fragmentSource(fragmentSource), _program(0), _vertexShader(0), _fragmentShader(0) {}
+
+    Shader(const Shader &) = delete;
+    Shader &operator=(const Shader &) = delete;
+
     ~Shader()
     {
         if (_program != 0 && _vertexShader != 0)
@@ -113,15 +140,29 @@ public:
      * Create the program
      * Attach the shaders
      * Link
+     *
+     * @param cache If set, the linked program is loaded from / stored to this cache.
      * */
-    void Build()
+    void Build(ProgramCache *cache = nullptr)
     {
-        _vertexShader = CompileShader(GL_VERTEX_SHADER, vertexShaderSource);
-        _fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+        const std::vector<std::string> sources = {_vertexSource, _fragmentSource};
+        if (cache != nullptr && cache->Load(sources, _program))
+        {
+            std::cout << "[Shader] loaded from cache : " << _program << std::endl;
+            return;
+        }
+
+        _vertexShader = CompileShader(GL_VERTEX_SHADER, _vertexSource.c_str());
+        _fragmentShader = CompileShader(GL_FRAGMENT_SHADER, _fragmentSource.c_str());
         _program = glCreateProgram();
         glAttachShader(_program, _vertexShader);
         glAttachShader(_program, _fragmentShader);
+        if (cache != nullptr)
+            cache->Prepare(_program);
         glLinkProgram(_program);
+        CheckCompileErrors(_program, "PROGRAM");
+        if (cache != nullptr)
+            cache->Store(sources, _program);
         std::cout << "[Shader] built : " << _program << std::endl;
     }
 
@@ -157,13 +198,13 @@ public:
      *
      * @param name The name of the uniform.
      * @param texture The texture.
-     * @todo Handle more texture unit.
+     * @param unit The texture unit it is bound to (one per sampler of the program).
      */
-    void SetTexture(const std::string &name, const Texture &texture)
+    void SetTexture(const std::string &name, const Texture &texture, int unit = 0)
     {
-        glActiveTexture(GL_TEXTURE0);
+        glActiveTexture(GL_TEXTURE0 + unit);
         texture.Bind();
-        glUniform1i(glGetUniformLocation(_program, name.c_str()), 0);
+        glUniform1i(glGetUniformLocation(_program, name.c_str()), unit);
     }
 
 private:
@@ -203,6 +244,9 @@ private:
     }
 
 private:
+    std::string _vertexSource;
+    std::string _fragmentSource;
+
     GLuint _program;
     GLuint _vertexShader;
     GLuint _fragmentShader;
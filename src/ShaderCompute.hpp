@@ -2,49 +2,392 @@
 #define ShaderCompute_hpp
 
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "GL.hpp"
+#include "Kernel.hpp"
+#include "ProgramCache.hpp"
 
-const char *shaderSource = R"(
+// Size of the square workgroup tile, must match TILE in the generated source
+const int computeTileSize = 16;
+
+/**
+ * @brief Generate the compute shader of a convolution pass.
+ *
+ * Tiled convolution: each 16x16 workgroup loads its input tile plus the halo of the pass into shared
+ * memory once, then every invocation convolves from shared memory instead of issuing one imageLoad per tap.
+ * The taps are unrolled with the weights as literals, zero weights are skipped.
+ *
+ * @param name The name of the kernel (comment only).
+ * @param sizeX The width of the pass (odd).
+ * @param sizeY The height of the pass (odd).
+ * @param weights The sizeX * sizeY weights in row-major order.
+ * @param scale The factor applied to the weighted sum.
+ * @param bias The value added after scaling, in [0, 255] units.
+ * @param inputFormat The image format of the input (rgba8, rgba32f).
+ * @param outputFormat The image format of the output (rgba8, rgba32f).
+ * @return The GLSL source.
+ * @throw std::runtime_error If the tile does not fit the guaranteed 32 KB of shared memory.
+ */
+inline std::string GenerateComputeShader(const std::string &name, int sizeX, int sizeY, const std::vector<float> &weights, float scale, float bias,
+                                         const std::string &inputFormat = "rgba8", const std::string &outputFormat = "rgba8")
+{
+    // vec3 may be padded to 16 bytes in shared memory
+    if ((computeTileSize + sizeX - 1) * (computeTileSize + sizeY - 1) * 16 > 32768)
+        throw std::runtime_error("Kernel " + name + " is too large for the compute shader tile");
+
+    std::ostringstream source;
+    source << R"(
     #version 430
 
-    layout(local_size_x = 1, local_size_y = 1) in;
+    // Kernel )" << name << " (" << sizeX << "x" << sizeY << R"()
+    #define TILE )" << computeTileSize << R"(
+    #define RADIUS_X )" << sizeX / 2 << R"(
+    #define RADIUS_Y )" << sizeY / 2 << R"(
+    #define HALO_X (TILE + 2 * RADIUS_X)
+    #define HALO_Y (TILE + 2 * RADIUS_Y)
 
-    layout(binding = 0, rgba8) uniform readonly image2D inputImage;
-    layout(binding = 1, rgba8) uniform writeonly image2D outputImage;
+    layout(local_size_x = TILE, local_size_y = TILE) in;
 
-    // Laplacian edge detection kernel
-    const float kernel[9] = float[](
-        1,  1,  1,
-        1, -8,  1,
-        1,  1,  1
-    );
+    layout(binding = 0, )" << inputFormat << R"() uniform readonly image2D inputImage;
+    layout(binding = 1, )" << outputFormat << R"() uniform writeonly image2D outputImage;
+
+    shared vec3 tile[HALO_Y][HALO_X];
 
     void main() {
         ivec2 size = imageSize(inputImage);
         ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+        ivec2 local = ivec2(gl_LocalInvocationID.xy);
+
+        // Cooperative load of the tile and its halo (clamped to the image borders)
+        ivec2 origin = ivec2(gl_WorkGroupID.xy) * TILE - ivec2(RADIUS_X, RADIUS_Y);
+        for (int i = int(gl_LocalInvocationIndex); i < HALO_X * HALO_Y; i += TILE * TILE) {
+            ivec2 t = ivec2(i % HALO_X, i / HALO_X);
+            ivec2 src = clamp(origin + t, ivec2(0), size - 1);
+            tile[t.y][t.x] = imageLoad(inputImage, src).rgb;
+        }
 
+        memoryBarrierShared();
+        barrier();
+
+        // Out of image invocations still had to take part in the load and the barrier
         if (pos.x >= size.x || pos.y >= size.y)
             return;
 
         vec3 sum = vec3(0.0);
-        for (int ky = -1; ky <= 1; ky++) {
-            for (int kx = -1; kx <= 1; kx++) {
-                ivec2 offset = clamp(pos + ivec2(kx, ky), ivec2(0), size - 1);
-                vec4 pixel = imageLoad(inputImage, offset);
-                float weight = kernel[(ky + 1) * 3 + (kx + 1)];
-                sum += pixel.rgb * weight;
+)";
+
+    for (int ky = 0; ky < sizeY; ++ky)
+        for (int kx = 0; kx < sizeX; ++kx)
+            if (weights[ky * sizeX + kx] != 0.0f)
+                source << "        sum += tile[local.y + " << ky << "][local.x + " << kx << "] * " << GlslFloat(weights[ky * sizeX + kx]) << ";\n";
+
+    source << "\n        imageStore(outputImage, pos, vec4(sum";
+    if (scale != 1.0f)
+        source << " * " << GlslFloat(scale);
+    if (bias != 0.0f)
+        source << " + " << GlslFloat(bias / 255.0f);
+    source << ", 1.0));\n    }\n";
+
+    return source.str();
+}
+
+/**
+ * @brief Generate the compute shader applying all the taps of a kernel.
+ */
+inline std::string GenerateComputeShader(const Kernel &kernel)
+{
+    return GenerateComputeShader(kernel.name, kernel.size, kernel.size, kernel.weights, kernel.Scale(), kernel.bias);
+}
+
+/**
+ * @brief Generate the compute shader filtering packed 8-bit BGR pixels in shader storage buffers.
+ *
+ * The input buffer holds the bytes of the cv::Mat rows (3 per pixel, inputPitch bytes per row), so the host
+ * uploads and downloads the image as is, without adding and dropping an alpha channel. Each 16x16 workgroup
+ * unpacks its tile and halo into shared memory, convolves in [0, 255] units (a separable kernel as a
+ * horizontal then a vertical pass over the shared tile), then packs its 16 x 3 bytes per row into whole
+ * 32-bit words: neighbouring workgroups never write the same word as long as outputPitch is a multiple of 4.
+ *
+ * Uniforms: size (location 0, in pixels), inputPitch (1) and outputPitch (2) in bytes.
+ *
+ * @param kernel The kernel.
+ * @return The GLSL source.
+ * @throw std::runtime_error If the tile does not fit the guaranteed 32 KB of shared memory.
+ */
+inline std::string GenerateComputePackedShader(const Kernel &kernel)
+{
+    std::vector<float> column, row;
+    const bool separable = kernel.IsSeparable(column, row);
+
+    // vec3 may be padded to 16 bytes in shared memory, plus the packed result and the horizontal sums
+    const int halo = computeTileSize + kernel.size - 1;
+    const int sharedBytes = halo * halo * 16 + computeTileSize * computeTileSize * 3 * 4 + (separable ? halo * computeTileSize * 16 : 0);
+    if (sharedBytes > 32768)
+        throw std::runtime_error("Kernel " + kernel.name + " is too large for the compute shader tile");
+
+    std::ostringstream source;
+    source << R"(
+    #version 430
+
+    // Kernel )" << kernel.name << " (" << kernel.size << "x" << kernel.size << R"(), packed BGR8
+    #define TILE )" << computeTileSize << R"(
+    #define RADIUS )" << kernel.Radius() << R"(
+    #define HALO (TILE + 2 * RADIUS)
+
+    layout(local_size_x = TILE, local_size_y = TILE) in;
+
+    layout(std430, binding = 0) readonly buffer InputPixels { uint inputWords[]; };
+    layout(std430, binding = 1) writeonly buffer OutputPixels { uint outputWords[]; };
+
+    layout(location = 0) uniform ivec2 size;
+    layout(location = 1) uniform int inputPitch;
+    layout(location = 2) uniform int outputPitch;
+
+    shared vec3 tile[HALO][HALO];
+    shared uint result[TILE][TILE * 3];
+)";
+    if (separable)
+        source << "    shared vec3 rows[HALO][TILE];\n";
+
+    source << R"(
+    float LoadByte(int offset) {
+        return float((inputWords[offset >> 2] >> ((offset & 3) * 8)) & 0xFFu);
+    }
+
+    void main() {
+        ivec2 local = ivec2(gl_LocalInvocationID.xy);
+
+        // Cooperative load of the tile and its halo (clamped to the image borders)
+        ivec2 origin = ivec2(gl_WorkGroupID.xy) * TILE - ivec2(RADIUS);
+        for (int i = int(gl_LocalInvocationIndex); i < HALO * HALO; i += TILE * TILE) {
+            ivec2 t = ivec2(i % HALO, i / HALO);
+            ivec2 src = clamp(origin + t, ivec2(0), size - 1);
+            int offset = src.y * inputPitch + src.x * 3;
+            tile[t.y][t.x] = vec3(LoadByte(offset), LoadByte(offset + 1), LoadByte(offset + 2));
+        }
+
+        memoryBarrierShared();
+        barrier();
+
+)";
+
+    if (separable)
+    {
+        source << "        // Horizontal pass over every row of the tile and its vertical halo\n"
+               << "        for (int y = local.y; y < HALO; y += TILE) {\n"
+               << "            vec3 h = vec3(0.0);\n";
+        for (int k = 0; k < kernel.size; ++k)
+            if (row[k] != 0.0f)
+                source << "            h += tile[y][local.x + " << k << "] * " << GlslFloat(row[k]) << ";\n";
+        source << "            rows[y][local.x] = h;\n"
+               << "        }\n\n"
+               << "        memoryBarrierShared();\n"
+               << "        barrier();\n\n"
+               << "        vec3 sum = vec3(0.0);\n";
+        for (int k = 0; k < kernel.size; ++k)
+            if (column[k] != 0.0f)
+                source << "        sum += rows[local.y + " << k << "][local.x] * " << GlslFloat(column[k]) << ";\n";
+    }
+    else
+    {
+        source << "        vec3 sum = vec3(0.0);\n";
+        for (int ky = 0; ky < kernel.size; ++ky)
+            for (int kx = 0; kx < kernel.size; ++kx)
+                if (kernel.weights[ky * kernel.size + kx] != 0.0f)
+                    source << "        sum += tile[local.y + " << ky << "][local.x + " << kx << "] * " << GlslFloat(kernel.weights[ky * kernel.size + kx]) << ";\n";
+    }
+
+    source << "\n        uvec3 value = uvec3(clamp(roundEven(sum";
+    if (kernel.Scale() != 1.0f)
+        source << " * " << GlslFloat(kernel.Scale());
+    if (kernel.bias != 0.0f)
+        source << " + " << GlslFloat(kernel.bias);
+    source << R"(), 0.0, 255.0));
+        result[local.y][local.x * 3] = value.x;
+        result[local.y][local.x * 3 + 1] = value.y;
+        result[local.y][local.x * 3 + 2] = value.z;
+
+        memoryBarrierShared();
+        barrier();
+
+        // One word per invocation, 12 words per row of the tile (past the image width: row padding)
+        int y = int(gl_WorkGroupID.y) * TILE + local.y;
+        int rowByte = int(gl_WorkGroupID.x) * TILE * 3 + local.x * 4;
+        if (local.x < TILE * 3 / 4 && y < size.y && rowByte < outputPitch) {
+            int b = local.x * 4;
+            outputWords[(y * outputPitch + rowByte) >> 2] = result[local.y][b] | (result[local.y][b + 1] << 8) |
+                                                            (result[local.y][b + 2] << 16) | (result[local.y][b + 3] << 24);
+        }
+    }
+)";
+
+    return source.str();
+}
+
+/**
+ * @brief Generate the compute shader filtering packed 8-bit BGR pixels with several adjacent output pixels
+ * per invocation.
+ *
+ * 4 BGR pixels are exactly 3 words: with rows padded to whole words (inputPitch and outputPitch multiples
+ * of 4), each invocation loads the words under its window with no per-pixel address math, unpacks their
+ * bytes into a row of pixels held in registers, slides the taps of the kernel over that row and stores its
+ * pixels as 3 * pixels / 4 words. Only the invocations whose window crosses the left or right border load
+ * pixel by pixel (clamped). Same buffers and uniforms as GenerateComputePackedShader(), and the same
+ * arithmetic: [0, 255] units, the horizontal then the vertical sums of a separable kernel and roundEven,
+ * so the outputs of both are identical.
+ *
+ * @param kernel The kernel.
+ * @param pixels The output pixels per invocation (4 or 8).
+ * @return The GLSL source.
+ * @throw std::runtime_error If pixels is not 4 or 8.
+ */
+inline std::string GenerateComputeStripShader(const Kernel &kernel, int pixels)
+{
+    if (pixels != 4 && pixels != 8)
+        throw std::runtime_error("Invalid pixels per invocation " + std::to_string(pixels) + " (4 or 8)");
+
+    std::vector<float> column, row;
+    const bool separable = kernel.IsSeparable(column, row);
+
+    // Whole groups of 4 pixels (3 words) on each side of the strip cover the radius
+    const int radius = kernel.Radius();
+    const int groups = (radius + 3) / 4;
+
+    std::ostringstream source;
+    source << R"(
+    #version 430
+
+    // Kernel )" << kernel.name << " (" << kernel.size << "x" << kernel.size << "), packed BGR8, " << pixels << R"( pixels per invocation
+    #define TILE )" << computeTileSize << R"(
+    #define RADIUS )" << radius << R"(
+    #define PIXELS )" << pixels << R"(
+    #define GROUPS )" << groups << R"(
+    #define SPAN (PIXELS + 8 * GROUPS)
+
+    layout(local_size_x = TILE, local_size_y = TILE) in;
+
+    layout(std430, binding = 0) readonly buffer InputPixels { uint inputWords[]; };
+    layout(std430, binding = 1) writeonly buffer OutputPixels { uint outputWords[]; };
+
+    layout(location = 0) uniform ivec2 size;
+    layout(location = 1) uniform int inputPitch;
+    layout(location = 2) uniform int outputPitch;
+
+    float LoadByte(int offset) {
+        return float((inputWords[offset >> 2] >> ((offset & 3) * 8)) & 0xFFu);
+    }
+
+    vec4 UnpackBytes(uint word) {
+        return vec4((uvec4(word) >> uvec4(0u, 8u, 16u, 24u)) & 0xFFu);
+    }
+
+    uint PackBytes(uvec4 bytes) {
+        return bytes.x | (bytes.y << 8) | (bytes.z << 16) | (bytes.w << 24);
+    }
+
+    // The SPAN pixels of an input row starting GROUPS * 4 pixels left of the strip
+    void LoadRow(int row, int x0, bool interior, out vec3 px[SPAN]) {
+        int first = x0 - 4 * GROUPS;
+        if (interior) {
+            int word = (row + first * 3) >> 2;
+            for (int g = 0; g < SPAN / 4; ++g) {
+                vec4 a = UnpackBytes(inputWords[word + 3 * g]);
+                vec4 b = UnpackBytes(inputWords[word + 3 * g + 1]);
+                vec4 c = UnpackBytes(inputWords[word + 3 * g + 2]);
+                px[4 * g] = a.xyz;
+                px[4 * g + 1] = vec3(a.w, b.xy);
+                px[4 * g + 2] = vec3(b.zw, c.x);
+                px[4 * g + 3] = c.yzw;
+            }
+        } else {
+            for (int j = 0; j < SPAN; ++j) {
+                int offset = row + clamp(first + j, 0, size.x - 1) * 3;
+                px[j] = vec3(LoadByte(offset), LoadByte(offset + 1), LoadByte(offset + 2));
             }
         }
+    }
+
+    void main() {
+        int x0 = int(gl_GlobalInvocationID.x) * PIXELS;
+        int y = int(gl_GlobalInvocationID.y);
+        if (x0 >= size.x || y >= size.y)
+            return;
+
+        bool interior = x0 >= 4 * GROUPS && x0 + PIXELS + 4 * GROUPS <= size.x;
+        vec3 px[SPAN];
+        vec3 sum[PIXELS];
+        for (int i = 0; i < PIXELS; ++i)
+            sum[i] = vec3(0.0);
+)";
+
+    // Pixel i of the strip reads px[i + kx + shift]
+    const int shift = 4 * groups - radius;
+    for (int ky = 0; ky < kernel.size; ++ky)
+    {
+        bool used = separable && column[ky] != 0.0f;
+        if (!separable)
+            for (int kx = 0; kx < kernel.size; ++kx)
+                used = used || kernel.weights[ky * kernel.size + kx] != 0.0f;
+        if (!used)
+            continue;
+
+        source << "\n        LoadRow(clamp(y + " << ky - radius << ", 0, size.y - 1) * inputPitch, x0, interior, px);\n"
+               << "        for (int i = 0; i < PIXELS; ++i) {\n";
+        if (separable)
+        {
+            // The horizontal sum of the row, then its vertical tap, in the order of the packed shader
+            source << "            vec3 h = vec3(0.0);\n";
+            for (int kx = 0; kx < kernel.size; ++kx)
+                if (row[kx] != 0.0f)
+                    source << "            h += px[i + " << kx + shift << "] * " << GlslFloat(row[kx]) << ";\n";
+            source << "            sum[i] += h * " << GlslFloat(column[ky]) << ";\n";
+        }
+        else
+        {
+            for (int kx = 0; kx < kernel.size; ++kx)
+                if (kernel.weights[ky * kernel.size + kx] != 0.0f)
+                    source << "            sum[i] += px[i + " << kx + shift << "] * " << GlslFloat(kernel.weights[ky * kernel.size + kx]) << ";\n";
+        }
+        source << "        }\n";
+    }
+
+    source << "\n        uvec3 value[PIXELS];\n"
+           << "        for (int i = 0; i < PIXELS; ++i)\n"
+           << "            value[i] = uvec3(clamp(roundEven(sum[i]";
+    if (kernel.Scale() != 1.0f)
+        source << " * " << GlslFloat(kernel.Scale());
+    if (kernel.bias != 0.0f)
+        source << " + " << GlslFloat(kernel.bias);
+    source << R"(), 0.0, 255.0));
 
-        imageStore(outputImage, pos, vec4(sum, 1.0));
+        // 4 pixels per 3 words (past the image width: row padding, past the pitch: not written)
+        int word = (y * outputPitch + x0 * 3) >> 2;
+        for (int g = 0; g < PIXELS / 4; ++g) {
+            uint words[3] = uint[3](PackBytes(uvec4(value[4 * g], value[4 * g + 1].x)),
+                                     PackBytes(uvec4(value[4 * g + 1].yz, value[4 * g + 2].xy)),
+                                     PackBytes(uvec4(value[4 * g + 2].z, value[4 * g + 3])));
+            for (int k = 0; k < 3; ++k)
+                if ((x0 + 4 * g) * 3 + 4 * k < outputPitch)
+                    outputWords[word + 3 * g + k] = words[k];
+        }
     }
- )";
+)";
+
+    return source.str();
+}
 
 class ShaderCompute
 {
 public:
-    ShaderCompute() : _program(0), _shader(0) {}
+    explicit ShaderCompute(const std::string &source) : _source(source), _program(0), _shader(0) {}
+
+    ShaderCompute(const ShaderCompute &) = delete;
+    ShaderCompute &operator=(const ShaderCompute &) = delete;
+
     ~ShaderCompute()
     {
         if (_shader != 0)
@@ -66,11 +409,23 @@ public:
         glUseProgram(_program);
     }
 
-    void Build()
+    /**
+     * Build the compute shader and link the program.
+     *
+     * @param cache If set, the linked program is loaded from / stored to this cache.
+     */
+    void Build(ProgramCache *cache = nullptr)
     {
+        const std::vector<std::string> sources = {_source};
+        if (cache != nullptr && cache->Load(sources, _program))
+        {
+            std::cout << "[Shader] loaded from cache : " << _program << std::endl;
+            return;
+        }
 
         _shader = glCreateShader(GL_COMPUTE_SHADER);
-        glShaderSource(_shader, 1, &shaderSource, nullptr);
+        const char *source = _source.c_str();
+        glShaderSource(_shader, 1, &source, nullptr);
         glCompileShader(_shader);
 
         GLint success;
@@ -85,10 +440,16 @@ public:
 
         _program = glCreateProgram();
         glAttachShader(_program, _shader);
+        if (cache != nullptr)
+            cache->Prepare(_program);
         glLinkProgram(_program);
+        if (cache != nullptr)
+            cache->Store(sources, _program);
     }
 
 private:
+    std::string _source;
+
     GLuint _program;
     GLuint _shader;
 };
@@ -0,0 +1,151 @@
+#ifndef StorageBuffer_hpp
+#define StorageBuffer_hpp
+
+#include <cstring>
+#include <stdexcept>
+#include <opencv2/opencv.hpp>
+
+#include "GL.hpp"
+
+/**
+ * Shader storage buffer holding 8-bit BGR pixels exactly as cv::Mat stores them (3 bytes per pixel, no alpha),
+ * so images go to and from the compute shader without any color conversion.
+ */
+class StorageBuffer
+{
+public:
+    StorageBuffer() : _ID(0), _size(0) {}
+    ~StorageBuffer()
+    {
+        if (_ID != 0)
+        {
+            std::cout << "[StorageBuffer] Deleting : " << _ID << std::endl;
+            glDeleteBuffers(1, &_ID);
+        }
+    }
+
+    StorageBuffer(const StorageBuffer &) = delete;
+    StorageBuffer &operator=(const StorageBuffer &) = delete;
+
+    GLuint ID() const { return _ID; }
+    GLsizeiptr Size() const { return _size; }
+
+    /**
+     * @brief Make sure the buffer holds at least size bytes.
+     * The buffer is generated on first use, afterwards the storage is only re-specified when it grows.
+     *
+     * @param size The number of bytes.
+     * @param usage The usage hint (GL_STREAM_DRAW for inputs, GL_STREAM_READ for outputs).
+     * @return true if the storage was (re)specified.
+     */
+    bool Allocate(GLsizeiptr size, GLenum usage)
+    {
+        if (_ID != 0 && size <= _size)
+            return false;
+
+        if (_ID == 0)
+            glGenBuffers(1, &_ID);
+
+        _size = size;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _ID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _size, nullptr, usage);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        std::cout << "[StorageBuffer] Allocated : " << _ID << " [" << _size << " bytes]" << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief Upload an 8-bit BGR image, 3 bytes per pixel and pitch bytes per row.
+     * A continuous image without row padding is a single copy, otherwise the rows are copied one by one
+     * into the mapped buffer.
+     *
+     * @param image The image to upload (any row stride).
+     * @param pitch The bytes per buffer row (at least image.cols * 3).
+     */
+    void Upload(const cv::Mat &image, GLsizeiptr pitch)
+    {
+        CV_Assert(image.type() == CV_8UC3);
+
+        const GLsizeiptr rowBytes = static_cast<GLsizeiptr>(image.cols) * 3;
+        // The shader reads whole words, the last one may run past the pixels
+        Allocate(AlignedSize(pitch * image.rows), GL_STREAM_DRAW);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _ID);
+        if (pitch == rowBytes && image.isContinuous())
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, rowBytes * image.rows, image.data);
+        else
+        {
+            uint8_t *mapped = static_cast<uint8_t *>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, pitch * image.rows, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+            if (mapped == nullptr)
+            {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                throw std::runtime_error("StorageBuffer glMapBufferRange failed");
+            }
+            for (int y = 0; y < image.rows; ++y)
+                std::memcpy(mapped + pitch * y, image.ptr<uint8_t>(y), rowBytes);
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    /**
+     * @brief Read 8-bit BGR rows back into an image.
+     * The buffer is mapped once, the rows are copied straight into the image.
+     *
+     * @param image The destination (8-bit BGR, allocated by the caller, any row stride).
+     * @param firstRow The buffer row of the first image row.
+     * @param pitch The bytes per buffer row (at least image.cols * 3).
+     */
+    void Download(cv::Mat &image, int firstRow, GLsizeiptr pitch)
+    {
+        CV_Assert(image.type() == CV_8UC3);
+        if (image.rows == 0)
+            return;
+
+        const GLsizeiptr rowBytes = static_cast<GLsizeiptr>(image.cols) * 3;
+        const GLsizeiptr offset = pitch * firstRow;
+        const GLsizeiptr length = pitch * (image.rows - 1) + rowBytes;
+        if (offset + length > _size)
+            throw std::runtime_error("StorageBuffer download past the end of the buffer");
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _ID);
+        const uint8_t *mapped = static_cast<const uint8_t *>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, offset, length, GL_MAP_READ_BIT));
+        if (mapped == nullptr)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            throw std::runtime_error("StorageBuffer glMapBufferRange failed");
+        }
+
+        if (pitch == rowBytes && image.isContinuous())
+            std::memcpy(image.data, mapped, length);
+        else
+            for (int y = 0; y < image.rows; ++y)
+                std::memcpy(image.ptr<uint8_t>(y), mapped + pitch * y, rowBytes);
+
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    /**
+     * @brief Bind the buffer to an indexed binding point of the shaders (layout(binding = index)).
+     */
+    void BindBase(GLuint index) const
+    {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, index, _ID);
+    }
+
+    /**
+     * @brief A size rounded up to whole 32-bit words.
+     */
+    static GLsizeiptr AlignedSize(GLsizeiptr size)
+    {
+        return (size + 3) & ~static_cast<GLsizeiptr>(3);
+    }
+
+private:
+    GLuint _ID;
+    GLsizeiptr _size;
+};
+
+#endif // StorageBuffer_hpp
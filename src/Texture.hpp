@@ -9,7 +9,7 @@
 class Texture
 {
 public:
-    Texture() : _ID(0) {}
+    Texture() : _ID(0), _width(0), _height(0), _internalFormat(0) {}
     ~Texture()
     {
         if (_ID != 0)
@@ -20,11 +20,14 @@ public:
     }
 
     GLuint ID() const { return _ID; }
+    int Width() const { return _width; }
+    int Height() const { return _height; }
 
     void Create(int width, int height)
     {
         _width = width;
         _height = height;
+        _internalFormat = GL_RGB;
 
         glGenTextures(1, &_ID);
 
@@ -47,6 +50,7 @@ public:
     {
         _width = image.cols;
         _height = image.rows;
+        _internalFormat = GL_RGB;
 
         glGenTextures(1, &_ID);
 
@@ -65,6 +69,67 @@ public:
         std::cout << "[Texture] Loaded from image : " << _ID << " [" << _width << " x " << _height << "]" << std::endl;
     }
 
+    /**
+     * @brief Make sure the storage matches the requested size and format.
+     * The texture is generated on first use, afterwards the storage is only re-specified
+     * (same texture name) when the size or the format changes.
+     *
+     * @param width The width of the texture.
+     * @param height The height of the texture.
+     * @param internalFormat The internal format (GL_RGB8, GL_RGBA8, ...).
+     * @return true if the storage was (re)specified.
+     */
+    bool Allocate(int width, int height, GLint internalFormat)
+    {
+        if (_ID != 0 && width == _width && height == _height && internalFormat == _internalFormat)
+            return false;
+
+        if (_ID == 0)
+        {
+            glGenTextures(1, &_ID);
+            glBindTexture(GL_TEXTURE_2D, _ID);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        }
+
+        _width = width;
+        _height = height;
+        _internalFormat = internalFormat;
+
+        glBindTexture(GL_TEXTURE_2D, _ID);
+        glTexImage2D(GL_TEXTURE_2D, 0, _internalFormat, _width, _height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        std::cout << "[Texture] Allocated : " << _ID << " [" << _width << " x " << _height << "]" << std::endl;
+        return true;
+    }
+
+    /**
+     * @brief Upload an 8-bit BGR or BGRA image (RGB8 or RGBA8 storage).
+     * Only the first upload or a change of size re-specifies the storage, the pixels are
+     * otherwise written in place with glTexSubImage2D.
+     *
+     * @param image The image to upload (any row stride).
+     */
+    void Upload(const cv::Mat &image)
+    {
+        CV_Assert(image.depth() == CV_8U && (image.channels() == 3 || image.channels() == 4));
+
+        const bool bgra = image.channels() == 4;
+        Allocate(image.cols, image.rows, bgra ? GL_RGBA8 : GL_RGB8);
+
+        Bind();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(image.step / image.elemSize()));
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _width, _height, bgra ? GL_BGRA : GL_BGR, GL_UNSIGNED_BYTE, image.data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        UnBind();
+    }
+
     void Bind() const
     {
         glBindTexture(GL_TEXTURE_2D, _ID);
@@ -84,11 +149,20 @@ public:
         UnBind();
     }
 
-    void ToMat(cv::Mat &mat)
+    /**
+     * @brief Read the texture back into a BGR (or BGRA) image.
+     * The image is only reallocated when its size or type differs.
+     *
+     * @param mat The destination image.
+     * @param channels 3 for BGR, 4 for BGRA.
+     */
+    void ToMat(cv::Mat &mat, int channels = 3)
     {
-        mat = cv::Mat(_height, _width, CV_8UC3);
+        mat.create(_height, _width, CV_8UC(channels));
         Bind();
-        glGetTexImage(GL_TEXTURE_2D, 0, GL_BGR, GL_UNSIGNED_BYTE, mat.data);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, channels == 4 ? GL_BGRA : GL_BGR, GL_UNSIGNED_BYTE, mat.data);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
         UnBind();
     }
 
@@ -96,6 +170,7 @@ private:
     GLuint _ID;
     int _width;
     int _height;
+    GLint _internalFormat;
 };
 
 #endif // Texture_hpp
\ No newline at end of file
@@ -0,0 +1,328 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Persistent work-stealing thread pool of the CPU filters.
+ *
+ * The workers are started once and sleep between calls. A parallel-for spreads its items over the deques of
+ * the workers it may use, in contiguous blocks: each worker pops its own deque from the front (neighbouring
+ * tiles, warm caches) and, once empty, steals from the back of the others. The calling thread takes part
+ * in its own call, so a call limited to one thread never leaves it, and short calls start without waiting
+ * for a sleeping worker.
+ *
+ * The parallelism is limited per call (no global state): a call allowed n threads uses the caller and
+ * n - 1 workers, the workers of consecutive calls rotate. Calls may come from several threads at once,
+ * and from inside a running item.
+ *
+ * Settings of Shared(): GL_COMPUTE_THREADS (default: the hardware threads), GL_COMPUTE_PIN_THREADS=1 pins
+ * each worker to a core.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @brief Start the workers.
+     *
+     * @param threads The parallelism, the calling thread included (threads - 1 workers are started).
+     * @param pin Pin each worker to one of the allowed cores.
+     */
+    explicit ThreadPool(int threads, bool pin = false) : _queues(std::max(threads - 1, 0)), _next(0), _generation(0), _stop(false)
+    {
+        std::vector<int> cores;
+        if (pin)
+        {
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+                for (int core = 0; core < CPU_SETSIZE; ++core)
+                    if (CPU_ISSET(core, &allowed))
+                        cores.push_back(core);
+        }
+
+        for (size_t i = 0; i < _queues.size(); ++i)
+        {
+            _workers.emplace_back([this, i]()
+                                  { Work(i); });
+
+            // Worker i on the core after the first one, the first core is left to the calling thread
+            if (!cores.empty())
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cores[(i + 1) % cores.size()], &set);
+                pthread_setaffinity_np(_workers.back().native_handle(), sizeof(set), &set);
+            }
+        }
+
+        std::cout << "[ThreadPool] Started : " << Threads() << " threads" << (cores.empty() ? "" : " (pinned)") << std::endl;
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (std::thread &worker : _workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief The maximum parallelism of a call (workers and calling thread).
+     */
+    int Threads() const { return static_cast<int>(_queues.size()) + 1; }
+
+    /**
+     * @brief Run body(x, y) for every cell of a countX x countY range and wait for all of them.
+     * The cells are scheduled row-major. The first exception thrown by a cell is rethrown here
+     * (the other cells still run).
+     *
+     * @param countX The width of the range.
+     * @param countY The height of the range.
+     * @param maxThreads The maximum number of threads working on the call (<= 0: all of them).
+     * @param body The work of a cell.
+     */
+    void ParallelFor2D(int countX, int countY, int maxThreads, const std::function<void(int x, int y)> &body)
+    {
+        ParallelFor(countX * countY, maxThreads, [countX, &body](int index)
+                    { body(index % countX, index / countX); });
+    }
+
+    /**
+     * @brief Run body(index) for every index of [0, count) and wait for all of them (see ParallelFor2D()).
+     */
+    void ParallelFor(int count, int maxThreads, const std::function<void(int index)> &body)
+    {
+        if (count <= 0)
+            return;
+
+        const int limit = maxThreads <= 0 ? Threads() : std::min(maxThreads, Threads());
+        const int workers = std::min(limit, count) - 1;
+        if (workers <= 0)
+        {
+            for (int index = 0; index < count; ++index)
+                body(index);
+            return;
+        }
+
+        Job job;
+        job.body = &body;
+        job.first = static_cast<int>(_next.fetch_add(workers) % _queues.size());
+        job.workers = workers;
+        job.remaining = count;
+
+        // Contiguous blocks, one per worker
+        for (int w = 0; w < workers; ++w)
+        {
+            Queue &queue = _queues[(job.first + w) % _queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for (int index = count * w / workers; index < count * (w + 1) / workers; ++index)
+                queue.items.push_back({&job, index});
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _generation++;
+        }
+        _wake.notify_all();
+
+        // Help with the items of this call, then wait for the ones in progress
+        Item item;
+        while (Steal(_queues.size(), &job, item))
+            Run(item);
+
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.done.wait(lock, [&job]()
+                      { return job.finished; });
+
+        if (job.error)
+            std::rethrow_exception(job.error);
+    }
+
+    /**
+     * @brief The pool of the process, started on first use.
+     */
+    static ThreadPool &Shared()
+    {
+        static ThreadPool pool(ThreadsFromEnv(), PinFromEnv());
+        return pool;
+    }
+
+private:
+    struct Job
+    {
+        const std::function<void(int)> *body = nullptr;
+        // The workers allowed to run the items: first, first + 1, ... (modulo the pool size)
+        int first = 0;
+        int workers = 0;
+
+        std::atomic<int> remaining{0};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable done;
+        bool finished = false;
+    };
+
+    struct Item
+    {
+        Job *job = nullptr;
+        int index = 0;
+    };
+
+    // One cache line per deque, the owner and the thieves lock it
+    struct alignas(64) Queue
+    {
+        std::mutex mutex;
+        std::deque<Item> items;
+    };
+
+    static int ThreadsFromEnv()
+    {
+        if (const char *text = std::getenv("GL_COMPUTE_THREADS"))
+        {
+            const int threads = std::atoi(text);
+            if (threads > 0)
+                return threads;
+            std::cout << "[ThreadPool] Invalid GL_COMPUTE_THREADS=" << text << ", using every hardware thread" << std::endl;
+        }
+        return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    static bool PinFromEnv()
+    {
+        const char *text = std::getenv("GL_COMPUTE_PIN_THREADS");
+        return text != nullptr && std::string(text) == "1";
+    }
+
+    /**
+     * @brief Is worker w one of the workers of a job.
+     */
+    bool Allowed(const Job &job, size_t w) const
+    {
+        return static_cast<int>((w + _queues.size() - job.first) % _queues.size()) < job.workers;
+    }
+
+    /**
+     * @brief Take an item from the back of a deque other than the thief's own.
+     *
+     * @param thief The index of the stealing worker (the pool size for a calling thread).
+     * @param job If set, only the items of this job are taken (calling threads).
+     * @param item The stolen item.
+     */
+    bool Steal(size_t thief, const Job *job, Item &item)
+    {
+        for (size_t k = 1; k <= _queues.size(); ++k)
+        {
+            const size_t victim = (thief + k) % (_queues.size() + 1);
+            if (victim == _queues.size())
+                continue;
+
+            Queue &queue = _queues[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for (auto it = queue.items.rbegin(); it != queue.items.rend(); ++it)
+            {
+                const bool eligible = job != nullptr ? it->job == job : Allowed(*it->job, thief);
+                if (eligible)
+                {
+                    item = *it;
+                    queue.items.erase(std::next(it).base());
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool Pop(size_t w, Item &item)
+    {
+        Queue &queue = _queues[w];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.items.empty())
+            return false;
+        item = queue.items.front();
+        queue.items.pop_front();
+        return true;
+    }
+
+    void Run(const Item &item)
+    {
+        Job &job = *item.job;
+        try
+        {
+            (*job.body)(item.index);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (!job.error)
+                job.error = std::current_exception();
+        }
+
+        // The job lives on the stack of its caller: it may return as soon as the lock is released
+        if (job.remaining.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.finished = true;
+            job.done.notify_one();
+        }
+    }
+
+    void Work(size_t w)
+    {
+        for (;;)
+        {
+            const uint64_t seen = _generation.load();
+
+            Item item;
+            if (Pop(w, item) || Steal(w, nullptr, item))
+            {
+                Run(item);
+                continue;
+            }
+
+            // Spin a little before sleeping, back-to-back calls then start without a wake-up
+            for (int spin = 0; spin < 256 && _generation.load() == seen && !_stop.load(); ++spin)
+                std::this_thread::yield();
+            if (_generation.load() != seen)
+                continue;
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [this, seen]()
+                       { return _stop.load() || _generation.load() != seen; });
+            if (_stop.load())
+                return;
+        }
+    }
+
+private:
+    std::vector<Queue> _queues;
+    std::vector<std::thread> _workers;
+    std::atomic<uint64_t> _next;
+
+    // Bumped by every call, the workers sleep until it changes
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::atomic<uint64_t> _generation;
+    std::atomic<bool> _stop;
+};
+
+#endif // ThreadPool_hpp
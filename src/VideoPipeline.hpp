@@ -0,0 +1,229 @@
+#ifndef VideoPipeline_hpp
+#define VideoPipeline_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "Benchmark.hpp"
+#include "BoundedQueue.hpp"
+
+/**
+ * Settings of a VideoPipeline run.
+ */
+struct VideoConfig
+{
+    // Live source (camera): frames arriving while the filter is behind are dropped instead of queued
+    bool live = false;
+    // Frames waiting between two stages at most
+    int queueDepth = 4;
+    // Codec of the output (4 characters)
+    std::string fourcc = "mp4v";
+};
+
+/**
+ * Measurements of a VideoPipeline run. The latency of a frame runs from the end of its decoding to the
+ * end of its encoding (queues and frames in flight included).
+ */
+struct VideoStats
+{
+    int frames = 0;
+    int dropped = 0;
+    double seconds = 0.0;
+    // Milliseconds per frame
+    BenchmarkStats latency;
+    double maxLatency = 0.0;
+
+    void Print(std::ostream &out) const
+    {
+        out << "[VideoPipeline] " << frames << " frames in " << seconds << " s, " << (seconds > 0.0 ? frames / seconds : 0.0)
+            << " frames/s, " << dropped << " dropped" << std::endl;
+        out << "[VideoPipeline] Latency (ms) : p50 " << latency.median << ", p90 " << latency.p90 << ", p99 " << latency.p99
+            << ", max " << maxLatency << std::endl;
+    }
+};
+
+/**
+ * Filters a video: a decode thread reads the frames (cv::VideoCapture), the calling thread, holding the GL
+ * context, filters them and an encode thread writes them (cv::VideoWriter). The stages are joined by
+ * bounded queues and the frame buffers go back to the stage that fills them, so the steady state does not
+ * allocate.
+ *
+ * The filter stage pulls frames from a source and pushes the results to a sink in order, e.g. the
+ * FramePipeline keeping several frames in flight on the GPU with textures reused across frames.
+ */
+class VideoPipeline
+{
+public:
+    typedef std::function<bool(cv::Mat &frame)> Source;
+    typedef std::function<void(const cv::Mat &result)> Sink;
+    typedef std::function<void(const Source &source, const Sink &sink)> FilterStage;
+
+    /**
+     * @throw std::runtime_error If the queues have no room or the codec is not 4 characters.
+     */
+    explicit VideoPipeline(const VideoConfig &config) : _config(config)
+    {
+        if (config.queueDepth < 1)
+            throw std::runtime_error("The video queues need at least one slot");
+        if (config.fourcc.size() != 4)
+            throw std::runtime_error("Invalid codec " + config.fourcc + " (4 characters expected)");
+    }
+
+    /**
+     * @brief Filter every frame of a capture into a video file of the same frame rate.
+     *
+     * @param capture The opened source.
+     * @param outputPath The video to write, opened on the first frame (its size).
+     * @param filter Filters the frames of the source into the sink, on the calling thread.
+     * @throw std::runtime_error If the output cannot be opened.
+     */
+    VideoStats Run(cv::VideoCapture &capture, const std::string &outputPath, const FilterStage &filter)
+    {
+        typedef std::chrono::steady_clock clock;
+
+        double fps = capture.get(cv::CAP_PROP_FPS);
+        if (!(fps > 0.0 && fps < 1000.0))
+            fps = 30.0;
+
+        BoundedQueue<Frame> decoded(_config.queueDepth);
+        BoundedQueue<Frame> filtered(_config.queueDepth);
+
+        // Buffers given back to the stage filling them, a few more than the frames in the queues
+        BoundedQueue<cv::Mat> freeInputs(_config.queueDepth + 2);
+        BoundedQueue<cv::Mat> freeOutputs(_config.queueDepth + 2);
+
+        std::atomic<int> dropped(0);
+        auto decode = [&]()
+        {
+            while (true)
+            {
+                Frame frame;
+                freeInputs.TryPop(frame.image);
+                if (!capture.read(frame.image) || frame.image.empty())
+                    break;
+                frame.decoded = clock::now();
+
+                if (_config.live)
+                {
+                    if (decoded.TryPush(std::move(frame)))
+                        continue;
+                    if (decoded.Closed())
+                        break;
+                    dropped++;
+                    freeInputs.TryPush(std::move(frame.image));
+                }
+                else if (!decoded.Push(std::move(frame)))
+                    break;
+            }
+            decoded.Close();
+        };
+
+        std::vector<double> latencies;
+        std::string error;
+        auto encode = [&]()
+        {
+            cv::VideoWriter writer;
+            Frame frame;
+            while (filtered.Pop(frame))
+            {
+                if (!writer.isOpened())
+                {
+                    const std::string &code = _config.fourcc;
+                    if (!writer.open(outputPath, cv::VideoWriter::fourcc(code[0], code[1], code[2], code[3]), fps, frame.image.size(), true))
+                    {
+                        error = "Cannot open " + outputPath + " for writing (" + code + ")";
+                        decoded.Close();
+                        filtered.Close();
+                        break;
+                    }
+                }
+                writer.write(frame.image);
+                latencies.push_back(std::chrono::duration<double, std::milli>(clock::now() - frame.decoded).count());
+                freeOutputs.TryPush(std::move(frame.image));
+            }
+        };
+
+        // Decode times of the frames in the filter stage, in order
+        std::deque<clock::time_point> inFlight;
+        cv::Mat previous;
+        Source source = [&](cv::Mat &image)
+        {
+            // The previous frame is uploaded once the next one is requested
+            if (!previous.empty())
+                freeInputs.TryPush(std::move(previous));
+
+            Frame frame;
+            if (!decoded.Pop(frame))
+                return false;
+            inFlight.push_back(frame.decoded);
+            image = frame.image;
+            previous = frame.image;
+            return true;
+        };
+        Sink sink = [&](const cv::Mat &result)
+        {
+            Frame frame;
+            freeOutputs.TryPop(frame.image);
+            result.copyTo(frame.image);
+            frame.decoded = inFlight.front();
+            inFlight.pop_front();
+            filtered.Push(std::move(frame));
+        };
+
+        const auto start = clock::now();
+        std::thread decoder(decode);
+        std::thread encoder(encode);
+
+        // On failure of the filter, the queues are closed so the other stages stop
+        try
+        {
+            filter(source, sink);
+        }
+        catch (...)
+        {
+            decoded.Close();
+            filtered.Close();
+            decoder.join();
+            encoder.join();
+            throw;
+        }
+
+        // The source may stop before the end of the capture
+        decoded.Close();
+        filtered.Close();
+        decoder.join();
+        encoder.join();
+
+        if (!error.empty())
+            throw std::runtime_error(error);
+
+        VideoStats stats;
+        stats.frames = static_cast<int>(latencies.size());
+        stats.dropped = dropped;
+        stats.seconds = std::chrono::duration<double>(clock::now() - start).count();
+        stats.latency = BenchmarkStats::From(latencies);
+        for (double latency : latencies)
+            stats.maxLatency = std::max(stats.maxLatency, latency);
+        return stats;
+    }
+
+private:
+    struct Frame
+    {
+        cv::Mat image;
+        std::chrono::steady_clock::time_point decoded;
+    };
+
+    VideoConfig _config;
+};
+
+#endif // VideoPipeline_hpp
@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "Benchmark.hpp"
+#include "FilterClient.hpp"
+#include "FilterProtocol.hpp"
+#include "Kernel.hpp"
+
+/**
+ * @brief Print the command line usage.
+ */
+void PrintUsage(const char *program)
+{
+    std::cout << "Usage: " << program << " [--socket PATH] [--kernel NAME|FILE] [--method NAME] [--requests N] [--warmup N] [--inline-limit BYTES] [--output FILE] IMAGE" << std::endl;
+    std::cout << "  --socket        Socket of the server (default $GL_COMPUTE_SOCKET, else $XDG_RUNTIME_DIR/gl-compute.sock)." << std::endl;
+    std::cout << "  --kernel        Kernel to apply: edge (default), sharp, gaussian5 or a kernel file." << std::endl;
+    std::cout << "  --method        Backend of the server (default: the one of the server)." << std::endl;
+    std::cout << "  --requests      Timed requests (default 100)." << std::endl;
+    std::cout << "  --warmup        Untimed requests first (default 5)." << std::endl;
+    std::cout << "  --inline-limit  Largest image sent through the socket, larger ones use shared memory (default 262144)." << std::endl;
+    std::cout << "  --output        Write the filtered image." << std::endl;
+}
+
+/**
+ * @brief Parse a strictly positive (or zero when allowed) integer argument.
+ */
+bool ParseCount(const char *text, long &value, bool allowZero)
+{
+    char *end = nullptr;
+    const long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < (allowZero ? 0 : 1))
+        return false;
+    value = parsed;
+    return true;
+}
+
+/**
+ * Sends the same image to a running gl-compute server (--serve) repeatedly and reports the latency of the
+ * requests, transfers included, next to the time the server spent filtering.
+ */
+int main(int argc, char **argv)
+{
+    try
+    {
+        std::string socketPath = FilterProtocol::DefaultSocketPath();
+        std::string kernelName = "edge";
+        std::string method;
+        std::string imagePath, outputPath;
+        long requests = 100, warmup = 5, inlineLimit = 256 * 1024;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--socket" && hasValue)
+                socketPath = argv[++i];
+            else if (arg == "--kernel" && hasValue)
+                kernelName = argv[++i];
+            else if (arg == "--method" && hasValue)
+                method = argv[++i];
+            else if (arg == "--requests" && hasValue && ParseCount(argv[i + 1], requests, false))
+                ++i;
+            else if (arg == "--warmup" && hasValue && ParseCount(argv[i + 1], warmup, true))
+                ++i;
+            else if (arg == "--inline-limit" && hasValue && ParseCount(argv[i + 1], inlineLimit, true))
+                ++i;
+            else if (arg == "--output" && hasValue)
+                outputPath = argv[++i];
+            else if (arg[0] != '-' && imagePath.empty())
+                imagePath = arg;
+            else
+            {
+                PrintUsage(argv[0]);
+                return arg == "--help" ? 0 : 1;
+            }
+        }
+        if (imagePath.empty())
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        const Kernel kernel = Kernel::FromName(kernelName);
+        const cv::Mat input = cv::imread(imagePath, cv::IMREAD_COLOR);
+        if (input.empty())
+        {
+            std::cout << "Cannot read " << imagePath << std::endl;
+            return 1;
+        }
+
+        FilterClient client(socketPath, static_cast<size_t>(inlineLimit));
+        const bool shared = FilterProtocol::ImageBytes(input.cols, input.rows) > static_cast<size_t>(inlineLimit);
+        std::cout << "Sending " << imagePath << " (" << input.cols << "x" << input.rows << ", " << kernel.name << ") to " << socketPath
+                  << (shared ? " through shared memory" : " inline") << std::endl;
+
+        typedef std::chrono::steady_clock clock;
+        cv::Mat output;
+        std::vector<double> latencies, filterTimes;
+        for (long i = 0; i < warmup + requests; ++i)
+        {
+            const auto t0 = clock::now();
+            client.Filter(input, output, kernel, method);
+            const auto t1 = clock::now();
+            if (i < warmup)
+                continue;
+
+            latencies.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+            filterTimes.push_back(static_cast<double>(client.LastFilterNanoseconds()));
+        }
+
+        const BenchmarkStats latency = BenchmarkStats::From(latencies);
+        const BenchmarkStats filter = BenchmarkStats::From(filterTimes);
+        std::cout << "Latency (ms) over " << latency.samples << " requests : min " << latency.min * 1e-6 << ", p50 " << latency.median * 1e-6
+                  << ", p90 " << latency.p90 * 1e-6 << ", p99 " << latency.p99 * 1e-6 << std::endl;
+        std::cout << "Server filtering (ms) : p50 " << filter.median * 1e-6 << ", p99 " << filter.p99 * 1e-6 << std::endl;
+
+        if (!outputPath.empty() && !cv::imwrite(outputPath, output))
+        {
+            std::cout << "Cannot write " << outputPath << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -1,298 +1,736 @@
 
+#include <chrono>
 #include <iostream>
 #include <vector>
 #include <opencv2/opencv.hpp>
-#include <chrono>
-#include <omp.h>
+#include <cstdlib>
+#include <exception>
+
+#include "AutoBackend.hpp"
+#include "BandStream.hpp"
+#include "BatchPipeline.hpp"
+#include "Benchmark.hpp"
+#include "Convolution.hpp"
+#include "CpuFilter.hpp"
+#include "CpuTiling.hpp"
+#include "FilterBackend.hpp"
+#include "FilterGraph.hpp"
+#include "FilterServer.hpp"
+#include "FramePipeline.hpp"
+#include "FrameRing.hpp"
+#include "GLContext.hpp"
+#include "GpuFilterContext.hpp"
+#include "GpuFilterGraph.hpp"
+#include "HybridBackend.hpp"
+#include "Kernel.hpp"
+#include "ThreadPool.hpp"
+#include "VideoPipeline.hpp"
+
+/**
+ * @brief Filter a sequence of frames using compute shader.
+ * The readback is asynchronous: the download of frame N overlaps the computation of frame N + 1.
+ *
+ * @param inputs The frames to filter.
+ * @param outputs The filtered frames.
+ * @param gpu The persistent GPU state.
+ */
+void FilterComputeShaderSequence(const std::vector<cv::Mat> &inputs, std::vector<cv::Mat> &outputs, GpuFilterContext &gpu)
+{
+    outputs.resize(inputs.size());
+
+    // Copy the oldest download out of its mapped buffer
+    size_t collected = 0;
+    auto collect = [&]()
+    {
+        cv::Mat mapped;
+        gpu.Readback().Acquire(mapped);
+        mapped.copyTo(outputs[collected++]);
+        gpu.Readback().Release();
+    };
+
+    for (const cv::Mat &input : inputs)
+    {
+        gpu.SubmitComputeShader(input);
 
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
+        // Keep the previous frame in flight until this one is queued
+        if (gpu.Readback().Pending() > 1)
+            collect();
+    }
 
-#include "Shader.hpp"
-#include "ShaderCompute.hpp"
-#include "FrameBuffer.hpp"
-#include "Quad.hpp"
+    while (collected < outputs.size())
+        collect();
+}
 
-// Convenience utils for durations
-typedef std::chrono::milliseconds ms;
-inline std::chrono::milliseconds toMS(std::chrono::high_resolution_clock::duration d)
+/**
+ * @brief Run a single fiter using both the CPU and the GPU and display the results.
+ *
+ * @param original The image to filter.
+ * @param backends The filter backends.
+ * @param kernel The kernel to apply.
+ */
+void RunSingle(const cv::Mat &original, const FilterBackendRegistry &backends, const Kernel &kernel)
 {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(d);
+    cv::Mat outputCPU, outputShader, outputComputeShader;
+
+    backends.Get("CPU").Filter(original, outputCPU, kernel);
+    backends.Get("CPU_MP").Filter(original, outputCPU, kernel);
+    backends.Get("Shader").Filter(original, outputShader, kernel);
+    backends.Get("Compute_Shader").Filter(original, outputComputeShader, kernel);
+
+    // Show
+    cv::imshow("Output CPU", outputCPU);
+    cv::imshow("Output GPU Shader", outputShader);
+    cv::imshow("Output GPU Compute Shader", outputComputeShader);
+    cv::waitKey(0);
 }
 
 /**
- * @brief Create an invisible window to hold an OpenGL context.
- * @return GLFWwindow*
+ * @brief Print where the time of the GPU methods goes: GPU (timer queries) and CPU time per frame
+ * of each phase (upload, kernel, readback), in ms.
+ *
+ * @param original The image to filter.
+ * @param gpu The persistent GPU state.
+ * @param backends The filter backends (the GPU ones run on gpu).
+ * @param kernel The kernel to apply.
+ * @param config The settings of the benchmark (factors, warmup and iterations).
  */
-GLFWwindow *CreateWindow()
+void RunPhaseBreakdown(const cv::Mat &original, GpuFilterContext &gpu, const FilterBackendRegistry &backends, const Kernel &kernel,
+                       const BenchmarkConfig &config)
 {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
-
-    // Create the window [1x1] and invisible
-    GLFWwindow *window = glfwCreateWindow(1, 1, "Framebuffer", NULL, NULL);
-    if (window == NULL)
+    std::vector<std::pair<std::string, Benchmark::FilterFn>> methods;
+    for (const char *name : {"Shader", "Compute_Shader", "Compute_Packed"})
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return 0;
+        IFilterBackend &backend = backends.Get(name);
+        methods.emplace_back(name, [&backend, &kernel](const cv::Mat &input, cv::Mat &output)
+                             { backend.Filter(input, output, kernel); });
     }
 
-    return window;
+    GpuTimer &timer = gpu.Timer();
+
+    std::cout << "Method\tFactor\tPhase\tGPU\tCPU" << std::endl;
+    cv::Mat input, output;
+    for (int factor : config.factors)
+    {
+        cv::resize(original, input, cv::Size(factor * original.cols, factor * original.rows));
+        for (const auto &[name, filter] : methods)
+        {
+            for (int i = 0; i < config.warmup; ++i)
+                filter(input, output);
+
+            timer.Reset();
+            timer.SetEnabled(true);
+            for (int i = 0; i < config.iterations; ++i)
+                filter(input, output);
+            timer.SetEnabled(false);
+            timer.Print(std::cout, name + "\t" + std::to_string(factor) + "\t");
+        }
+    }
 }
 
 /**
- * @brief Apply the filter to an image using the CPU.
+ * @brief Run a benchmark of the filtering run time.
+ * Compare the methods:
+ *    # every registered backend: CPU with and without parallel processing, GPU vertex / fragment shaders,
+ *      GPU compute shader on textures and on packed buffers (1, 4 and 8 pixels per invocation),
+ *      Hybrid (CPU and GPU on the same frame), Auto
+ *    # GPU compute shader over a sequence of frames, asynchronous readback (reported per frame)
+ *    # Hybrid over a sequence of frames, each frame going whole to the CPU or the GPU (reported per frame)
  *
- * @param input The image to filter.
- * @param output The filtered image.
- * @param useParallel Should the function use parallel processing.
+ * Upscale the original image multiple times, then measure the run time of each method (after warmup calls)
+ * and print the statistics. The results are also written as CSV / JSON when requested.
+ * The GPU methods are then broken down into phases.
  *
- * @remark To avoid handling the clamping, the border pixels are ignored.
+ * @param original The image to filter.
+ * @param gpu The persistent GPU state.
+ * @param backends The filter backends (the GPU ones run on gpu).
+ * @param autoBackend The Auto backend of the registry, calibrated first.
+ * @param tiles The tile shapes of the CPU filter.
+ * @param kernel The kernel to apply.
+ * @param config The settings of the benchmark.
  */
-void FilterCPU(const cv::Mat &input, cv::Mat &output, bool useParallel)
+void RunBench(const cv::Mat &original, GpuFilterContext &gpu, const FilterBackendRegistry &backends, AutoBackend &autoBackend, const TileConfig &tiles,
+              const Kernel &kernel, BenchmarkConfig config)
 {
-    CV_Assert(input.channels() == 3); // Ensure RGB
-
-    cv::Mat kernel = (cv::Mat_<float>(3, 3) << 1, 1, 1,
-                      1, -8, 1,
-                      1, 1, 1); // Sharpen kernel
-
-    int rows = input.rows;
-    int cols = input.cols;
+    // Measured once per machine, before the benchmark so it is not timed
+    autoBackend.Calibrate(false);
 
-    // Create the output (same size and format as the input)
-    output = cv::Mat::zeros(rows, cols, CV_8UC3);
+    // Frames per sequence for the asynchronous readback
+    const int sequenceLength = 4;
+    std::vector<cv::Mat> outputSequence;
 
-    // Get the default number of threads before modifying
-    int defaultThreads = omp_get_max_threads();
+    // The asynchronous sequence runs on the context directly
+    gpu.SetKernel(kernel);
 
-    // No parallel => 1 thread only
-    if (!useParallel)
-        omp_set_num_threads(1); // Disable parallelism by using a single thread
+    const TileShape tile = tiles.Get(kernel, 1);
+    const TileShape tileMP = tiles.Get(kernel, ThreadPool::Shared().Threads());
 
-#pragma omp parallel for collapse(2) // Parallelize both y and x loops
-    for (int y = 1; y < rows - 1; ++y)
+    Benchmark bench;
+    const int pixelsPerThread = gpu.PixelsPerThread();
+    for (IFilterBackend *backend : backends.Backends())
     {
-        for (int x = 1; x < cols - 1; ++x)
+        if (backend->Name() != "Compute_Packed")
         {
-            for (int c = 0; c < 3; ++c)
-            { // R, G, B channels
-                float sum = 0.0f;
-                for (int ky = -1; ky <= 1; ++ky)
-                    for (int kx = -1; kx <= 1; ++kx)
-                        sum += input.at<cv::Vec3b>(y + ky, x + kx)[c] * kernel.at<float>(ky + 1, kx + 1);
-                output.at<cv::Vec3b>(y, x)[c] = cv::saturate_cast<uchar>(sum);
-            }
+            bench.Add(backend->Name(), [backend, &kernel](const cv::Mat &input, cv::Mat &output)
+                      { backend->Filter(input, output, kernel); });
+            continue;
         }
+
+        // Every pixels per invocation of the packed compute shader, the setting is restored for the other methods
+        for (int pixels : {1, 4, 8})
+            bench.Add(pixels == 1 ? backend->Name() : backend->Name() + "_x" + std::to_string(pixels), [&gpu, backend, &kernel, pixels, pixelsPerThread](const cv::Mat &input, cv::Mat &output)
+                      {
+                gpu.SetPixelsPerThread(pixels);
+                backend->Filter(input, output, kernel);
+                gpu.SetPixelsPerThread(pixelsPerThread); });
+    }
+    bench.Add("Compute_Async", [&](const cv::Mat &input, cv::Mat &)
+              { FilterComputeShaderSequence(std::vector<cv::Mat>(sequenceLength, input), outputSequence, gpu); },
+              sequenceLength);
+    IFilterBackend &hybrid = backends.Get("Hybrid");
+    bench.Add("Hybrid_Batch", [&](const cv::Mat &input, cv::Mat &)
+              { hybrid.FilterBatch(std::vector<cv::Mat>(sequenceLength, input), outputSequence, kernel); },
+              sequenceLength);
+
+    config.metadata["kernel"] = kernel.name + " (" + std::to_string(kernel.size) + "x" + std::to_string(kernel.size) + ")";
+    config.metadata["cpu_isa"] = CpuIsaName(ActiveCpuIsa());
+    config.metadata["cpu_threads"] = std::to_string(ThreadPool::Shared().Threads());
+    config.metadata["cpu_tile"] = std::to_string(tile.width) + "x" + std::to_string(tile.height);
+    config.metadata["cpu_tile_mp"] = std::to_string(tileMP.width) + "x" + std::to_string(tileMP.height);
+    for (auto [key, name] : {std::make_pair("gl_vendor", GL_VENDOR), std::make_pair("gl_renderer", GL_RENDERER), std::make_pair("gl_version", GL_VERSION)})
+    {
+        const GLubyte *value = glGetString(name);
+        config.metadata[key] = value != nullptr ? reinterpret_cast<const char *>(value) : "";
     }
 
-    // Restore the default threads
-    omp_set_num_threads(defaultThreads);
+    std::cout << "Kernel: " << config.metadata["kernel"] << std::endl;
+    std::cout << "CPU kernel: " << config.metadata["cpu_isa"] << std::endl;
+    std::cout << "CPU tiles: " << tile.width << "x" << tile.height << ", " << tileMP.width << "x" << tileMP.height << " (MP)" << std::endl;
+    std::cout << "Warmup: " << config.warmup << ", iterations: " << config.iterations << " (times in ms per frame)" << std::endl;
+    bench.Run(original, config);
+
+    std::cout << "Phases (ms per frame)" << std::endl;
+    RunPhaseBreakdown(original, gpu, backends, kernel, config);
 }
 
 /**
- * @brief Apply the filter to an image using the GPU (via OpenGL vertex and fragment shaders)
+ * @brief Filter an image larger than the memory band by band (see BandStream).
  *
- * @param input The image to filter.
- * @param output The filtered image.
- * @param window The window holding the GL context.
+ * @param backends The filter backends.
+ * @param kernel The kernel to apply.
+ * @param inputPath The source image (binary PPM).
+ * @param outputPath The filtered image (binary PPM).
+ * @param bandHeight The output rows per band.
+ * @param method The backend filtering the bands: CPU, CPU_MP, Shader, Compute_Shader, Compute_Packed, Hybrid or Auto.
+ * @throw std::runtime_error If the files cannot be read / written or the method is unknown.
  */
-void FilterShader(const cv::Mat &input, cv::Mat &output, GLFWwindow *window)
+void RunStream(const FilterBackendRegistry &backends, const Kernel &kernel, const std::string &inputPath, const std::string &outputPath, int bandHeight,
+               const std::string &method)
 {
-    int width = input.cols;
-    int height = input.rows;
-
-    // Build the shader
-    Shader shader;
-    shader.Build();
-
-    // Build the Quad
-    GLuint VAO;
-    BuildQuad(VAO);
-
-    // Build the input texture
-    Texture inputTexture;
-    inputTexture.Load(input);
-
-    // Build and bind the FrameBuffer (same size as the input)
-    FrameBuffer fbo;
-    fbo.Create(width, height);
-    fbo.Bind();
-    glViewport(0, 0, width, height);
-
-    // Set Shader input
-    shader.Use();
-    shader.SetUniform("width", static_cast<float>(width));
-    shader.SetUniform("height", static_cast<float>(height));
-    shader.SetTexture("inputTexture", inputTexture);
-
-    // Draw
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glBindVertexArray(0);
-
-    // Swap buffer and unbind
-    glfwSwapBuffers(window);
-    fbo.UnBind();
-
-    // Get the output
-    fbo.Color_0().ToMat(output);
+    IFilterBackend &backend = backends.Get(method);
+    BandStream::FilterFn filter = [&backend, &kernel](const cv::Mat &input, cv::Mat &output)
+    { backend.Filter(input, output, kernel); };
+
+    PpmReader reader(inputPath);
+    PpmWriter writer(outputPath, reader.Width(), reader.Height());
+    std::cout << "Streaming " << inputPath << " (" << reader.Width() << "x" << reader.Height() << ") with " << method
+              << ", bands of " << bandHeight << " rows" << std::endl;
+
+    BandStream stream(kernel.Radius(), bandHeight);
+    stream.Run(reader, writer, filter).Print(std::cout);
 }
 
 /**
- * @brief Filter the input image using compute shader.
+ * @brief Filter every image of a directory or list file into an output directory, decoding, filtering
+ * and encoding on separate threads (see BatchPipeline).
  *
- * @param input The image to filter.
- * @param output The filtered image.
+ * @param backends The filter backends.
+ * @param kernel The kernel to apply.
+ * @param input A directory of images or a text file listing one image per line.
+ * @param outputDir The directory of the filtered images.
+ * @param method The backend filtering the images.
+ * @param config The threads per stage and the depth of the queues.
+ * @throw std::runtime_error If the input cannot be listed or the method is unknown.
  */
-void FilterComputeShader(const cv::Mat &input, cv::Mat &output)
+void RunBatch(const FilterBackendRegistry &backends, const Kernel &kernel, const std::string &input, const std::string &outputDir,
+              const std::string &method, BatchConfig config)
 {
-    const int width = input.cols;
-    const int height = input.rows;
-
-    // Add an alpha channel to the input
-    cv::Mat inputRGBA;
-    cv::cvtColor(input, inputRGBA, cv::COLOR_RGB2RGBA);
-
-    // Input texture
-    GLuint texIn;
-    glGenTextures(1, &texIn);
-    glBindTexture(GL_TEXTURE_2D, texIn);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, inputRGBA.data);
-
-    // Output texture
-    GLuint texOut;
-    glGenTextures(1, &texOut);
-    glBindTexture(GL_TEXTURE_2D, texOut);
-    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
-
-    // Compute Shader
-    ShaderCompute shader;
-    shader.Build();
-
-    // Run
-    shader.Use();
-    glBindImageTexture(0, texIn, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA8);
-    glBindImageTexture(1, texOut, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
-    glDispatchCompute(width, height, 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-    glFinish();
-
-    // Get the output
-    cv::Mat resultRGBA(height, width, CV_8UC4);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, resultRGBA.data);
-
-    // Delete textures
-    glDeleteTextures(1, &texIn);
-    glDeleteTextures(1, &texOut);
-
-    // Drop the alpha on the output
-    cv::cvtColor(resultRGBA, output, cv::COLOR_RGBA2RGB);
+    IFilterBackend &backend = backends.Get(method);
+    BatchPipeline::FilterFn filter = [&backend, &kernel](const cv::Mat &image, cv::Mat &output)
+    { backend.Filter(image, output, kernel); };
+
+    // The GPU backends are bound to the GL context of this thread
+    if (config.filterThreads > 1 && method != "CPU" && method != "CPU_MP")
+    {
+        std::cout << "[BatchPipeline] " << method << " filters on the GL thread only, --filter-threads ignored" << std::endl;
+        config.filterThreads = 1;
+    }
+
+    const std::vector<std::filesystem::path> inputs = BatchPipeline::ListInputs(input);
+    std::cout << "Filtering " << inputs.size() << " images of " << input << " into " << outputDir << " with " << method << " ("
+              << config.decodeThreads << " decode, " << config.filterThreads << " filter, " << config.encodeThreads << " encode threads)" << std::endl;
+
+    BatchPipeline pipeline(config);
+    pipeline.Run(inputs, outputDir, filter).Print(std::cout);
 }
 
 /**
- * @brief Run a single fiter using both the CPU and the GPU and display the results.
+ * @brief Filter the frames of a shared memory ring written by another process into a second ring, read by
+ * a third one (see FrameRing). The filter reads the input slots and writes the output slots in place.
  *
- * @param original The image to filter.
- * @param window The window holding the GL context.
+ * @param backends The filter backends.
+ * @param kernel The kernel to apply.
+ * @param inputName The ring of the producer (already created by it).
+ * @param outputName The ring of the filtered frames, created with the geometry of the input ring.
+ * @param method The backend filtering the frames.
+ * @throw std::runtime_error If the rings cannot be opened / created or the method is unknown.
  */
-void RunSingle(const cv::Mat &original, GLFWwindow *window)
+void RunRing(const FilterBackendRegistry &backends, const Kernel &kernel, const std::string &inputName, const std::string &outputName,
+             const std::string &method)
 {
-    cv::Mat outputCPU, outputShader, outputComputeShader;
+    typedef std::chrono::steady_clock clock;
+
+    IFilterBackend &backend = backends.Get(method);
+    FrameRing input(inputName);
+    FrameRing output(outputName, input.Width(), input.Height(), input.Slots());
+    std::cout << "Filtering the frames of " << inputName << " (" << input.Width() << "x" << input.Height() << ", " << input.Slots()
+              << " slots) into " << outputName << " with " << method << std::endl;
+
+    int frames = 0, copies = 0;
+    const auto start = clock::now();
+    cv::Mat frame, slot;
+    uint64_t timestamp = 0;
+    while (input.Next(frame, &timestamp))
+    {
+        if (!output.Acquire(slot))
+            break;
 
-    FilterCPU(original, outputCPU, false);
-    FilterCPU(original, outputCPU, true);
-    FilterShader(original, outputShader, window);
-    FilterComputeShader(original, outputComputeShader);
+        // The backends fill an output of the right size in place, the others are copied
+        cv::Mat result = slot;
+        backend.Filter(frame, result, kernel);
+        if (result.data != slot.data)
+        {
+            result.copyTo(slot);
+            copies++;
+        }
 
-    // Show
-    cv::imshow("Output CPU", outputCPU);
-    cv::imshow("Output GPU Shader", outputShader);
-    cv::imshow("Output GPU Compute Shader", outputComputeShader);
-    cv::waitKey(0);
+        output.Publish(timestamp);
+        input.Release();
+        frames++;
+    }
+    output.Close();
+    if (input.PeerGone() || output.PeerGone())
+        std::cout << "[FrameRing] " << (input.PeerGone() ? "Producer" : "Consumer") << " exited without closing its ring" << std::endl;
+
+    const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    std::cout << "[FrameRing] " << frames << " frames in " << seconds << " s, " << (seconds > 0.0 ? frames / seconds : 0.0) << " frames/s";
+    if (copies > 0)
+        std::cout << " (" << copies << " copied out of the backend)";
+    std::cout << std::endl;
 }
 
 /**
- * @brief Run a benchmark of the filtering run time.
- * Compare three different methods:
- *    # CPU no parallel processing
- *    # CPU with parallel processing
- *    # GPU
+ * @brief Filter a video file or camera: decode, filter and encode run on separate threads (see VideoPipeline).
+ * Compute_Shader keeps several frames in flight in the FramePipeline (textures and buffers reused across
+ * frames), the other backends filter one frame at a time.
  *
- * Upscale the original image multiple times, then measure the run time of the three methods and print the results.
+ * @param gpu The persistent GPU state.
+ * @param backends The filter backends.
+ * @param kernel The kernel to apply.
+ * @param input The video file, or the index of a camera (live source, late frames are dropped).
+ * @param outputPath The filtered video.
+ * @param method The backend filtering the frames.
+ * @param config The queues, codec and drop policy.
+ * @throw std::runtime_error If the source or the output cannot be opened or the method is unknown.
+ */
+void RunVideo(GpuFilterContext &gpu, const FilterBackendRegistry &backends, const Kernel &kernel, const std::string &input,
+              const std::string &outputPath, const std::string &method, VideoConfig config)
+{
+    IFilterBackend &backend = backends.Get(method);
+
+    cv::VideoCapture capture;
+    const bool camera = !input.empty() && input.find_first_not_of("0123456789") == std::string::npos;
+    if (camera ? !capture.open(std::stoi(input)) : !capture.open(input))
+        throw std::runtime_error("Cannot open the video " + input);
+    config.live = config.live || camera;
+
+    std::cout << "Filtering " << (camera ? "camera " : "") << input << " into " << outputPath << " with " << method
+              << (config.live ? " (live, late frames dropped)" : "") << std::endl;
+
+    VideoPipeline::FilterStage filter;
+    PipelineStats gpuStats;
+    if (method == "Compute_Shader")
+    {
+        if (gpu.GetKernel().Key() != kernel.Key())
+            gpu.SetKernel(kernel);
+        filter = [&gpu, &gpuStats](const VideoPipeline::Source &source, const VideoPipeline::Sink &sink)
+        {
+            FramePipeline pipeline(gpu);
+            gpuStats = pipeline.Run(source, sink);
+        };
+    }
+    else
+        filter = [&backend, &kernel](const VideoPipeline::Source &source, const VideoPipeline::Sink &sink)
+        {
+            cv::Mat frame, output;
+            while (source(frame))
+            {
+                backend.Filter(frame, output, kernel);
+                sink(output);
+            }
+        };
+
+    VideoPipeline pipeline(config);
+    pipeline.Run(capture, outputPath, filter).Print(std::cout);
+    if (gpuStats.frames > 0)
+        gpuStats.Print(std::cout);
+}
+
+/**
+ * @brief Run a filter graph on the GPU (one upload, ping-pong FrameBuffers, only the outputs read back)
+ * and on the CPU (line buffers), then compare them, or benchmark the executors.
  *
  * @param original The image to filter.
- * @param window The window holding the GL context.
+ * @param spec The graph (see FilterGraph::Parse()).
+ * @param outputPath Write the GPU outputs (the second one as NAME_1.EXT, ...), shown when empty.
+ * @param bench Benchmark the executors instead.
+ * @param config The settings of the benchmark.
+ * @throw std::runtime_error If the graph is invalid or an output cannot be written.
  */
-void RunBench(const cv::Mat &original, GLFWwindow *window)
+void RunGraph(const cv::Mat &original, const std::string &spec, const std::string &outputPath, bool bench, BenchmarkConfig config)
 {
-    // Storage for the bench
-    std::vector<std::tuple<int, int, ms, ms, ms, ms>> timings;
+    const FilterGraph graph = FilterGraph::Parse(spec);
+    std::cout << "Graph " << spec << " : " << graph.Describe() << std::endl;
+
+    GpuFilterGraph gpuGraph;
+    CpuFilterGraph cpuGraph;
+    std::vector<cv::Mat> gpuOutputs, cpuOutputs;
 
-    cv::Mat input, outputCPU, outputShader, outputComputeShader;
-    std::vector<int> factors = {1, 2, 3, 4, 6, 8, 10};
-    for (int factor : factors)
+    if (bench)
     {
-        cv::resize(original, input, cv::Size(factor * original.cols, factor * original.rows));
-        // Filter
-        auto t0 = std::chrono::high_resolution_clock::now();
-        FilterCPU(input, outputCPU, false);
-        auto t1 = std::chrono::high_resolution_clock::now();
-        FilterCPU(input, outputCPU, true);
-        auto t2 = std::chrono::high_resolution_clock::now();
-        FilterShader(input, outputShader, window);
-        auto t3 = std::chrono::high_resolution_clock::now();
-        FilterComputeShader(input, outputShader);
-        auto t4 = std::chrono::high_resolution_clock::now();
-
-        auto durationCPU = toMS(t1 - t0);
-        auto durationCPU_MP = toMS(t2 - t1);
-        auto durationShader = toMS(t3 - t2);
-        auto durationComputeShader = toMS(t4 - t3);
-
-        timings.push_back(std::make_tuple(factor, input.cols * input.rows, durationCPU, durationCPU_MP, durationShader, durationComputeShader));
+        // The GPU executor filters one texture per node
+        GLint maxTextureSize = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        std::erase_if(config.factors, [&](int factor)
+                      { return std::max(original.cols, original.rows) * factor > maxTextureSize; });
+
+        Benchmark benchmark;
+        benchmark.Add("Graph_CPU", [&](const cv::Mat &input, cv::Mat &)
+                      { cpuGraph.Run(graph, input, cpuOutputs, false); });
+        benchmark.Add("Graph_CPU_MP", [&](const cv::Mat &input, cv::Mat &)
+                      { cpuGraph.Run(graph, input, cpuOutputs, true); });
+        benchmark.Add("Graph_Shader", [&](const cv::Mat &input, cv::Mat &)
+                      { gpuGraph.Run(graph, input, gpuOutputs); });
+        config.metadata["graph"] = spec;
+        std::cout << "Warmup: " << config.warmup << ", iterations: " << config.iterations << " (times in ms per frame)" << std::endl;
+        benchmark.Run(original, config);
+        std::cout << "[GpuFilterGraph] " << gpuGraph.Targets() << " FrameBuffers" << std::endl;
+        gpuGraph.Programs().PrintStats(std::cout);
+        return;
     }
 
-    std::cout << "Factor\tInput\tCPU\tCPU_MP\tShader\tCompute_Shader" << std::endl;
-    for (auto &triplet : timings)
+    gpuGraph.Run(graph, original, gpuOutputs);
+    cpuGraph.Run(graph, original, cpuOutputs);
+    std::cout << "[GpuFilterGraph] " << gpuGraph.Targets() << " FrameBuffers" << std::endl;
+
+    for (size_t o = 0; o < gpuOutputs.size(); ++o)
     {
-        std::cout << std::get<0>(triplet) << "\t";
-        std::cout << std::get<1>(triplet) << "\t";
-        std::cout << std::get<2>(triplet).count() << "\t";
-        std::cout << std::get<3>(triplet).count() << "\t";
-        std::cout << std::get<4>(triplet).count() << "\t";
-        std::cout << std::get<5>(triplet).count() << std::endl;
+        // Rounding of the 8-bit render targets and of the CPU kernels may differ by one level
+        const double maxDifference = cv::norm(gpuOutputs[o], cpuOutputs[o], cv::NORM_INF);
+        std::cout << "Output " << o << " (node " << graph.Outputs()[o] << ") : max GPU / CPU difference " << maxDifference << std::endl;
+
+        if (outputPath.empty())
+            cv::imshow("Graph output " + std::to_string(o), gpuOutputs[o]);
+        else
+        {
+            std::filesystem::path path = outputPath;
+            if (o > 0)
+                path.replace_filename(path.stem().string() + "_" + std::to_string(o) + path.extension().string());
+            if (!cv::imwrite(path.string(), gpuOutputs[o]))
+                throw std::runtime_error("Cannot write " + path.string());
+        }
     }
+    if (outputPath.empty())
+        cv::waitKey(0);
 }
 
-int main()
+/**
+ * @brief Sweep the tile shapes of the CPU filter for a kernel, single-threaded and with every thread,
+ * and store the fastest ones in the configuration file.
+ *
+ * @param original The image to filter (upscaled so the tiles are measured on a large frame).
+ * @param kernel The kernel to tune.
+ * @param tiles The configuration to update and save.
+ */
+void RunTileTuning(const cv::Mat &original, const Kernel &kernel, TileConfig &tiles)
 {
-    // Make the context current
-    GLFWwindow *window = CreateWindow();
-    glfwMakeContextCurrent(window);
+    const int factor = 2;
+    const int iterations = 3;
+    cv::Mat input, output;
+    cv::resize(original, input, cv::Size(factor * original.cols, factor * original.rows));
 
-    // initialise GLEW
-    glewExperimental = GL_TRUE; // stops glew crashing on OSX :-/
-    if (glewInit() != GLEW_OK)
-        throw std::runtime_error("glewInit failed");
+    const std::vector<TileShape> shapes = TileTuner::Candidates(input.cols, input.rows);
+    std::cout << "Tuning the CPU tiles of " << kernel.name << " on " << input.cols << "x" << input.rows << " (" << shapes.size() << " shapes)" << std::endl;
 
-    // Load the input image and create the containers
-    cv::Mat original = cv::imread("./res/montpellier.jpg");
+    for (bool parallel : {false, true})
+    {
+        // Same key as the single-threaded run
+        if (parallel && ThreadPool::Shared().Threads() == 1)
+            break;
+
+        const TileShape best = TileTuner::Tune([&](const TileShape &shape)
+                                               { FilterCPU(input, output, kernel, parallel, shape); },
+                                               shapes, iterations);
+        tiles.Set(kernel, parallel ? ThreadPool::Shared().Threads() : 1, best);
+    }
 
-    //********************************************* */
-    RunSingle(original, window);
-    // RunBench(original, window);
-    //********************************************* */
+    tiles.Save();
+}
 
-    // Clean up
-    glfwDestroyWindow(window);
-    glfwTerminate();
+/**
+ * @brief Print the command line usage.
+ */
+void PrintUsage(const char *program)
+{
+    std::cout << "Usage: " << program << " [--context auto|glfw|egl] [--kernel NAME|FILE] [--bench [--warmup N] [--iterations N] [--csv FILE] [--json FILE]] [--tune] [--calibrate] [--gpu-tile N] [--pixels-per-thread N] [--hybrid-gpu NAME]" << std::endl;
+    std::cout << "       " << program << " [--context auto|glfw|egl] [--kernel NAME|FILE] --stream INPUT.ppm OUTPUT.ppm [--band N] [--method NAME]" << std::endl;
+    std::cout << "       " << program << " [--context auto|glfw|egl] [--kernel NAME|FILE] --video INPUT|CAMERA OUTPUT [--method NAME] [--live] [--fourcc CODE] [--queue N]" << std::endl;
+    std::cout << "       " << program << " [--context auto|glfw|egl] [--kernel NAME|FILE] --ring-in NAME --ring-out NAME [--method NAME]" << std::endl;
+    std::cout << "       " << program << " [--context auto|glfw|egl] --serve [SOCKET] [--method NAME]" << std::endl;
+    std::cout << "       " << program << " [--context auto|glfw|egl] --graph SPEC [--output FILE] [--bench [--warmup N] [--iterations N] [--csv FILE] [--json FILE]]" << std::endl;
+    std::cout << "       " << program << " [--context auto|glfw|egl] [--kernel NAME|FILE] --batch INPUT OUTDIR [--method NAME] [--decode-threads N] [--filter-threads N] [--encode-threads N] [--queue N]" << std::endl;
+    std::cout << "  --context     Window system for the GL context: glfw (hidden window) or egl (headless)." << std::endl;
+    std::cout << "                auto picks glfw when a display server is available (default)." << std::endl;
+    std::cout << "  --kernel      Kernel to apply: edge (default), sharp, gaussian5 or a file holding the" << std::endl;
+    std::cout << "                size x size weights and optional \"divisor D\" / \"bias B\" entries." << std::endl;
+    std::cout << "  --bench       Benchmark every method instead of displaying the filtered image." << std::endl;
+    std::cout << "  --warmup      Untimed calls per method and size (default 2)." << std::endl;
+    std::cout << "  --iterations  Timed calls per method and size (default 10)." << std::endl;
+    std::cout << "  --csv         Write the benchmark results as CSV." << std::endl;
+    std::cout << "  --json        Write the benchmark results as JSON." << std::endl;
+    std::cout << "  --stream      Filter a binary PPM of any size band by band, without loading it whole." << std::endl;
+    std::cout << "  --band        Output rows per band (default 256)." << std::endl;
+    std::cout << "  --serve       Keep the context and programs warm and filter the requests of gl-compute-client on a UNIX socket" << std::endl;
+    std::cout << "                (default $GL_COMPUTE_SOCKET, else $XDG_RUNTIME_DIR/gl-compute.sock), --method is the default backend." << std::endl;
+    std::cout << "  --video       Filter a video file, or a camera by index, into OUTPUT (decode, filter and encode threads)." << std::endl;
+    std::cout << "                Compute_Shader (default) keeps 3 frames in flight on the GPU." << std::endl;
+    std::cout << "  --live        Drop the frames arriving while the filter is behind (always on for cameras)." << std::endl;
+    std::cout << "  --fourcc      Codec of the filtered video (default mp4v)." << std::endl;
+    std::cout << "  --ring-in, --ring-out  Filter the frames of a shared memory ring (shm_open name) of a producer process" << std::endl;
+    std::cout << "                into a ring created for the consumer process, without copy, until the producer closes its ring." << std::endl;
+    std::cout << "  --graph       Run a chain of operations entirely on the GPU (only the outputs are read back) and on the CPU" << std::endl;
+    std::cout << "                (line buffers), e.g. \"gaussian5,edge,threshold:32\". Steps: a kernel, threshold:LEVEL," << std::endl;
+    std::cout << "                blend:N:WA:WB[:BIAS] (WA * previous + WB * step N, 0 is the input) and out (also output the previous step)." << std::endl;
+    std::cout << "  --output      Write the GPU outputs of the graph instead of showing them." << std::endl;
+    std::cout << "  --batch       Filter every image of a directory (or of a file listing one path per line) into OUTDIR." << std::endl;
+    std::cout << "  --decode-threads, --filter-threads, --encode-threads" << std::endl;
+    std::cout << "                Threads of each batch stage (default 2, 1, 2). Only CPU and CPU_MP filter on more than one thread." << std::endl;
+    std::cout << "  --queue       Images / frames waiting between two batch or video stages at most (default 4)." << std::endl;
+    std::cout << "  --method      Backend of the bands / batch / video: CPU, CPU_MP (default), Shader, Compute_Shader, Compute_Packed, Hybrid or Auto." << std::endl;
+    std::cout << "  --gpu-tile    Largest GPU texture side, larger images are filtered in tiles (default GL_MAX_TEXTURE_SIZE)." << std::endl;
+    std::cout << "  --pixels-per-thread  Output pixels per invocation of Compute_Packed: 1 (default), 4 or 8." << std::endl;
+    std::cout << "  --hybrid-gpu  GPU backend running next to CPU_MP in the Hybrid method (default Shader)." << std::endl;
+    std::cout << "  --calibrate   Measure the costs of the backends again for the Auto method and save them" << std::endl;
+    std::cout << "                (GL_COMPUTE_COST_MODEL, default ~/.config/gl-compute/cost-model.conf)." << std::endl;
+    std::cout << "  --tune        Sweep the CPU tile shapes for the kernel and save the fastest ones" << std::endl;
+    std::cout << "                (GL_COMPUTE_TILE_CONFIG, default ~/.config/gl-compute/cpu-tiles.conf)." << std::endl;
+}
+
+/**
+ * @brief Parse a strictly positive (or zero when allowed) integer argument.
+ */
+bool ParseCount(const char *text, int &value, bool allowZero)
+{
+    char *end = nullptr;
+    const long parsed = std::strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < (allowZero ? 0 : 1) || parsed > 1000000)
+        return false;
+    value = static_cast<int>(parsed);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        ContextBackend backend = ContextBackend::Auto;
+        std::string kernelName = "edge";
+        bool bench = false;
+        bool tune = false;
+        bool calibrate = false;
+        std::string streamInput, streamOutput, method;
+        std::string batchInput, batchOutput;
+        BatchConfig batchConfig;
+        bool serve = false;
+        std::string ringInput, ringOutput;
+        std::string videoInput, videoOutput;
+        std::string graphSpec, graphOutput;
+        VideoConfig videoConfig;
+        int queueDepth = 4;
+        std::string socketPath = FilterProtocol::DefaultSocketPath();
+        int bandHeight = 256;
+        int gpuTile = 0;
+        int pixelsPerThread = 1;
+        std::string hybridGpu = "Shader";
+        BenchmarkConfig benchConfig;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--context" && hasValue && ParseContextBackend(argv[i + 1], backend))
+                ++i;
+            else if (arg == "--kernel" && hasValue)
+                kernelName = argv[++i];
+            else if (arg == "--bench")
+                bench = true;
+            else if (arg == "--tune")
+                tune = true;
+            else if (arg == "--calibrate")
+                calibrate = true;
+            else if (arg == "--stream" && i + 2 < argc)
+            {
+                streamInput = argv[++i];
+                streamOutput = argv[++i];
+            }
+            else if (arg == "--video" && i + 2 < argc)
+            {
+                videoInput = argv[++i];
+                videoOutput = argv[++i];
+            }
+            else if (arg == "--live")
+                videoConfig.live = true;
+            else if (arg == "--fourcc" && hasValue)
+                videoConfig.fourcc = argv[++i];
+            else if (arg == "--ring-in" && hasValue)
+                ringInput = argv[++i];
+            else if (arg == "--ring-out" && hasValue)
+                ringOutput = argv[++i];
+            else if (arg == "--serve")
+            {
+                serve = true;
+                if (hasValue && argv[i + 1][0] != '-')
+                    socketPath = argv[++i];
+            }
+            else if (arg == "--graph" && hasValue)
+                graphSpec = argv[++i];
+            else if (arg == "--output" && hasValue)
+                graphOutput = argv[++i];
+            else if (arg == "--batch" && i + 2 < argc)
+            {
+                batchInput = argv[++i];
+                batchOutput = argv[++i];
+            }
+            else if (arg == "--decode-threads" && hasValue && ParseCount(argv[i + 1], batchConfig.decodeThreads, false))
+                ++i;
+            else if (arg == "--filter-threads" && hasValue && ParseCount(argv[i + 1], batchConfig.filterThreads, false))
+                ++i;
+            else if (arg == "--encode-threads" && hasValue && ParseCount(argv[i + 1], batchConfig.encodeThreads, false))
+                ++i;
+            else if (arg == "--queue" && hasValue && ParseCount(argv[i + 1], queueDepth, false))
+                ++i;
+            else if (arg == "--band" && hasValue && ParseCount(argv[i + 1], bandHeight, false))
+                ++i;
+            else if (arg == "--gpu-tile" && hasValue && ParseCount(argv[i + 1], gpuTile, false))
+                ++i;
+            else if (arg == "--pixels-per-thread" && hasValue && ParseCount(argv[i + 1], pixelsPerThread, false) &&
+                     (pixelsPerThread == 1 || pixelsPerThread == 4 || pixelsPerThread == 8))
+                ++i;
+            else if (arg == "--hybrid-gpu" && hasValue)
+                hybridGpu = argv[++i];
+            else if (arg == "--method" && hasValue)
+                method = argv[++i];
+            else if (arg == "--warmup" && hasValue && ParseCount(argv[i + 1], benchConfig.warmup, true))
+                ++i;
+            else if (arg == "--iterations" && hasValue && ParseCount(argv[i + 1], benchConfig.iterations, false))
+                ++i;
+            else if (arg == "--csv" && hasValue)
+                benchConfig.csvPath = argv[++i];
+            else if (arg == "--json" && hasValue)
+                benchConfig.jsonPath = argv[++i];
+            else
+            {
+                PrintUsage(argv[0]);
+                return arg == "--help" ? 0 : 1;
+            }
+        }
+
+        // The video mode streams through the compute shader unless told otherwise
+        if (method.empty())
+            method = videoInput.empty() ? "CPU_MP" : "Compute_Shader";
+        batchConfig.queueDepth = queueDepth;
+        videoConfig.queueDepth = queueDepth;
+
+        // Kernel presets or file, validated before any GL work
+        const Kernel kernel = Kernel::FromName(kernelName);
+
+        // The demo image, only loaded by the modes filtering it: the tile tuning, the graph, the benchmark and the single filter
+        const bool otherMode = !videoInput.empty() || !ringInput.empty() || !ringOutput.empty() || serve || !streamInput.empty() || !batchInput.empty();
+        cv::Mat original;
+        if (tune || (videoInput.empty() && !graphSpec.empty()) || !otherMode)
+        {
+            const std::string imagePath = "./res/montpellier.jpg";
+            original = cv::imread(imagePath);
+            if (original.empty())
+                throw std::runtime_error("Cannot read " + imagePath + " (run from the directory holding res/)");
+        }
+
+        // The context outlives the GPU state of the scope below, which makes no GL call before the context is created
+        GLContext context;
 
-    return 0;
+        // CPU tile shapes of this machine
+        TileConfig tiles;
+        {
+            GpuFilterContext gpu(kernel);
+            gpu.SetMaxTileSize(gpuTile);
+            gpu.SetPixelsPerThread(pixelsPerThread);
+
+            // The backends, and the method and Hybrid GPU backend named on the command line, validated before any GL work
+            FilterBackendRegistry backends;
+            backends.Register(std::make_unique<CpuBackend>(tiles, false));
+            backends.Register(std::make_unique<CpuBackend>(tiles, true));
+            backends.Register(std::make_unique<GpuBackend>(gpu, GpuBackend::Path::Shader));
+            backends.Register(std::make_unique<GpuBackend>(gpu, GpuBackend::Path::Compute));
+            backends.Register(std::make_unique<GpuBackend>(gpu, GpuBackend::Path::ComputePacked));
+            backends.Register(std::make_unique<HybridBackend>(backends.Get("CPU_MP"), backends.Get(hybridGpu)));
+            AutoBackend &autoBackend = backends.Register(std::make_unique<AutoBackend>(backends));
+            backends.Get(method);
+
+            // Create the context and make it current (GLEW included)
+            context.Create(backend);
+
+            if (tune)
+                RunTileTuning(original, kernel, tiles);
+
+            // Measured once per machine (again when asked), before the run of the Auto method so it is not timed
+            if (calibrate || method == "Auto")
+                autoBackend.Calibrate(calibrate);
+
+            //********************************************* */
+            if (!videoInput.empty())
+                RunVideo(gpu, backends, kernel, videoInput, videoOutput, method, videoConfig);
+            else if (!graphSpec.empty())
+                RunGraph(original, graphSpec, graphOutput, bench, benchConfig);
+            else if (!ringInput.empty() || !ringOutput.empty())
+                RunRing(backends, kernel, ringInput, ringOutput, method);
+            else if (serve)
+                FilterServer(backends, method).Run(socketPath);
+            else if (!streamInput.empty())
+                RunStream(backends, kernel, streamInput, streamOutput, bandHeight, method);
+            else if (!batchInput.empty())
+                RunBatch(backends, kernel, batchInput, batchOutput, method, batchConfig);
+            else if (bench)
+                RunBench(original, gpu, backends, autoBackend, tiles, kernel, benchConfig);
+            else
+                RunSingle(original, backends, kernel);
+            //********************************************* */
+
+            gpu.Programs().PrintStats(std::cout);
+        }
+
+        return 0;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
 }